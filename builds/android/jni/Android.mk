@@ -16,6 +16,7 @@ LOCAL_SRC_FILES := \
     ${TOP_DIR}/source/cutils/mqueue.c \
     ${TOP_DIR}/source/cutils/ringbuf.c \
     ${TOP_DIR}/source/cutils/lockfree_ringbuf.c \
+    ${TOP_DIR}/source/cutils/broadcast_ringbuf.c \
     ${TOP_DIR}/source/cutils/swtimer.c \
     ${TOP_DIR}/source/cipher/sha2.c \
     ${TOP_DIR}/source/cipher/hmac_sha2.c \
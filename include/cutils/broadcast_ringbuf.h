@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2023-, Qinglong<sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SYSUTILS_BROADCAST_RINGBUF_H__
+#define __SYSUTILS_BROADCAST_RINGBUF_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "cutil_namespace.h"
+#include "ringbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Broadcast ringbuf: one writer, many readers. Every reader has its own read
+// cursor and sees all data written after it's added, space is reclaimed when
+// the slowest reader advances. Return values are the same as ringbuf.h:
+// bytes read/written, or RB_FAIL/RB_DONE/RB_ABORT/RB_TIMEOUT
+typedef struct broadcast_ringbuf *brb_handle;
+typedef struct broadcast_ringbuf_reader *brb_reader_handle;
+
+brb_handle brb_create(int size);
+
+// brb_destroy:
+//   Destroy ringbuf and all readers that aren't removed yet
+void brb_destroy(brb_handle rb);
+
+// brb_add_reader:
+//   Add a reader, which starts reading from current write position. If
+//   @drop_if_slow is set, writer never waits for this reader, the oldest
+//   data not read yet is dropped when there is no space, see
+//   brb_reader_dropped()
+brb_reader_handle brb_add_reader(brb_handle rb, bool drop_if_slow);
+
+void brb_remove_reader(brb_handle rb, brb_reader_handle reader);
+
+// brb_write:
+//   Write @len bytes, wait at most @timeout_ms (forever if zero) in total
+//   until all readers without drop_if_slow have read enough data
+int brb_write(brb_handle rb, char *buf, int len, unsigned int timeout_ms);
+
+// brb_done_write:
+//   Mark no more data will be written, readers get RB_DONE after all data
+//   is read
+void brb_done_write(brb_handle rb);
+
+// brb_abort:
+//   Abort writer and all readers
+void brb_abort(brb_handle rb);
+
+// brb_reset:
+//   Discard all data and clear done/abort status of writer and readers
+void brb_reset(brb_handle rb);
+
+int brb_get_size(brb_handle rb);
+
+// brb_bytes_available:
+//   Return bytes that can be written without waiting
+int brb_bytes_available(brb_handle rb);
+
+// brb_read:
+//   Read @len bytes for @reader, wait at most @timeout_ms (forever if zero)
+//   in total if there isn't enough data, same as rb_read()
+int brb_read(brb_reader_handle reader, char *buf, int len, unsigned int timeout_ms);
+
+// brb_reader_bytes_filled:
+//   Return bytes that @reader can read, at most size of ringbuf, zero if
+//   @reader is done or aborted
+int brb_reader_bytes_filled(brb_reader_handle reader);
+
+// brb_reader_set_threshold:
+//   Same as rb_set_threshold(), reader isn't woken up until it has
+//   @threshold bytes to read for the first time
+void brb_reader_set_threshold(brb_reader_handle reader, int threshold);
+
+// brb_reader_abort:
+//   Abort @reader only, its reads return RB_ABORT and writer doesn't wait for
+//   it like brb_reader_done(), so writer and other readers go on. Data not
+//   read yet is lost, brb_reset() makes it read again from the start
+void brb_reader_abort(brb_reader_handle reader);
+
+// brb_reader_done:
+//   Mark @reader won't read any more, writer doesn't wait for it, same as
+//   brb_remove_reader() except handle is kept valid
+void brb_reader_done(brb_reader_handle reader);
+
+// brb_reader_dropped:
+//   Return total bytes dropped for drop_if_slow @reader
+unsigned long long brb_reader_dropped(brb_reader_handle reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SYSUTILS_BROADCAST_RINGBUF_H__
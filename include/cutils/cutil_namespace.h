@@ -34,28 +34,61 @@
 #define message_set_free_cb            SYSUTILS_CUTILS_NAMESPACE(message_set_free_cb)
 #define message_set_discard_cb         SYSUTILS_CUTILS_NAMESPACE(message_set_discard_cb)
 #define message_set_timeout_cb         SYSUTILS_CUTILS_NAMESPACE(message_set_timeout_cb)
+#define message_set_result             SYSUTILS_CUTILS_NAMESPACE(message_set_result)
 #define mlooper_create                 SYSUTILS_CUTILS_NAMESPACE(mlooper_create)
+#define mlooper_create_with_attr       SYSUTILS_CUTILS_NAMESPACE(mlooper_create_with_attr)
 #define mlooper_destroy                SYSUTILS_CUTILS_NAMESPACE(mlooper_destroy)
+#define mlooper_message_obtain         SYSUTILS_CUTILS_NAMESPACE(mlooper_message_obtain)
+#define mlooper_message_obtain_buffer_obtain SYSUTILS_CUTILS_NAMESPACE(mlooper_message_obtain_buffer_obtain)
 #define mlooper_start                  SYSUTILS_CUTILS_NAMESPACE(mlooper_start)
 #define mlooper_stop                   SYSUTILS_CUTILS_NAMESPACE(mlooper_stop)
 #define mlooper_message_count          SYSUTILS_CUTILS_NAMESPACE(mlooper_message_count)
 #define mlooper_dump                   SYSUTILS_CUTILS_NAMESPACE(mlooper_dump)
+#define mlooper_add_idle_handler       SYSUTILS_CUTILS_NAMESPACE(mlooper_add_idle_handler)
+#define mlooper_remove_idle_handler    SYSUTILS_CUTILS_NAMESPACE(mlooper_remove_idle_handler)
+#define mlooper_get_stats              SYSUTILS_CUTILS_NAMESPACE(mlooper_get_stats)
+#define mlooper_reset_stats            SYSUTILS_CUTILS_NAMESPACE(mlooper_reset_stats)
 #define mlooper_post_message           SYSUTILS_CUTILS_NAMESPACE(mlooper_post_message)
 #define mlooper_post_message_front     SYSUTILS_CUTILS_NAMESPACE(mlooper_post_message_front)
 #define mlooper_post_message_delay     SYSUTILS_CUTILS_NAMESPACE(mlooper_post_message_delay)
+#define mlooper_post_message_coalesce  SYSUTILS_CUTILS_NAMESPACE(mlooper_post_message_coalesce)
+#define mlooper_send_message_sync      SYSUTILS_CUTILS_NAMESPACE(mlooper_send_message_sync)
 #define mlooper_remove_self_message    SYSUTILS_CUTILS_NAMESPACE(mlooper_remove_self_message)
 #define mlooper_remove_self_message_if SYSUTILS_CUTILS_NAMESPACE(mlooper_remove_self_message_if)
 #define mlooper_clear_self_message     SYSUTILS_CUTILS_NAMESPACE(mlooper_clear_self_message)
 #define mlooper_remove_message         SYSUTILS_CUTILS_NAMESPACE(mlooper_remove_message)
 #define mlooper_remove_message_if      SYSUTILS_CUTILS_NAMESPACE(mlooper_remove_message_if)
 #define mlooper_clear_message          SYSUTILS_CUTILS_NAMESPACE(mlooper_clear_message)
+#define mlooper_pool_create            SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_create)
+#define mlooper_pool_destroy           SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_destroy)
+#define mlooper_pool_start             SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_start)
+#define mlooper_pool_stop              SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_stop)
+#define mlooper_pool_message_count     SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_message_count)
+#define mlooper_pool_dump              SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_dump)
+#define mlooper_pool_post_message      SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_post_message)
+#define mlooper_pool_post_message_delay SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_post_message_delay)
+#define mlooper_pool_post_affinity_message SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_post_affinity_message)
+#define mlooper_pool_remove_message    SYSUTILS_CUTILS_NAMESPACE(mlooper_pool_remove_message)
 
 // mqueue.h
 #define mqueue_create                  SYSUTILS_CUTILS_NAMESPACE(mqueue_create)
+#define mqueue_create_on_node          SYSUTILS_CUTILS_NAMESPACE(mqueue_create_on_node)
+#define mqueue_create_lockfree         SYSUTILS_CUTILS_NAMESPACE(mqueue_create_lockfree)
+#define mqueue_create_prio             SYSUTILS_CUTILS_NAMESPACE(mqueue_create_prio)
+#define mqueue_create_varlen           SYSUTILS_CUTILS_NAMESPACE(mqueue_create_varlen)
 #define mqueue_destroy                 SYSUTILS_CUTILS_NAMESPACE(mqueue_destroy)
 #define mqueue_reset                   SYSUTILS_CUTILS_NAMESPACE(mqueue_reset)
 #define mqueue_send                    SYSUTILS_CUTILS_NAMESPACE(mqueue_send)
 #define mqueue_receive                 SYSUTILS_CUTILS_NAMESPACE(mqueue_receive)
+#define mqueue_send_prio               SYSUTILS_CUTILS_NAMESPACE(mqueue_send_prio)
+#define mqueue_send_varlen             SYSUTILS_CUTILS_NAMESPACE(mqueue_send_varlen)
+#define mqueue_receive_varlen          SYSUTILS_CUTILS_NAMESPACE(mqueue_receive_varlen)
+#define mqueue_send_batch              SYSUTILS_CUTILS_NAMESPACE(mqueue_send_batch)
+#define mqueue_receive_batch           SYSUTILS_CUTILS_NAMESPACE(mqueue_receive_batch)
+#define mqueue_send_reserve            SYSUTILS_CUTILS_NAMESPACE(mqueue_send_reserve)
+#define mqueue_send_commit             SYSUTILS_CUTILS_NAMESPACE(mqueue_send_commit)
+#define mqueue_receive_peek            SYSUTILS_CUTILS_NAMESPACE(mqueue_receive_peek)
+#define mqueue_receive_release         SYSUTILS_CUTILS_NAMESPACE(mqueue_receive_release)
 #define mqueue_count_available         SYSUTILS_CUTILS_NAMESPACE(mqueue_count_available)
 #define mqueue_count_filled            SYSUTILS_CUTILS_NAMESPACE(mqueue_count_filled)
 #define mqueueset_create               SYSUTILS_CUTILS_NAMESPACE(mqueueset_create)
@@ -63,9 +96,12 @@
 #define mqueueset_add_queue            SYSUTILS_CUTILS_NAMESPACE(mqueueset_add_queue)
 #define mqueueset_remove_queue         SYSUTILS_CUTILS_NAMESPACE(mqueueset_remove_queue)
 #define mqueueset_select_queue         SYSUTILS_CUTILS_NAMESPACE(mqueueset_select_queue)
+#define mqueueset_select_queues        SYSUTILS_CUTILS_NAMESPACE(mqueueset_select_queues)
 
 // ringbuf.h
 #define rb_create                      SYSUTILS_CUTILS_NAMESPACE(rb_create)
+#define rb_create_mirrored             SYSUTILS_CUTILS_NAMESPACE(rb_create_mirrored)
+#define rb_create_on_node              SYSUTILS_CUTILS_NAMESPACE(rb_create_on_node)
 #define rb_destroy                     SYSUTILS_CUTILS_NAMESPACE(rb_destroy)
 #define rb_abort                       SYSUTILS_CUTILS_NAMESPACE(rb_abort)
 #define rb_reset                       SYSUTILS_CUTILS_NAMESPACE(rb_reset)
@@ -76,15 +112,43 @@
 #define rb_write                       SYSUTILS_CUTILS_NAMESPACE(rb_write)
 #define rb_read_chunk                  SYSUTILS_CUTILS_NAMESPACE(rb_read_chunk)
 #define rb_write_chunk                 SYSUTILS_CUTILS_NAMESPACE(rb_write_chunk)
+#define rb_readv                       SYSUTILS_CUTILS_NAMESPACE(rb_readv)
+#define rb_writev                      SYSUTILS_CUTILS_NAMESPACE(rb_writev)
+#define rb_write_from_fd               SYSUTILS_CUTILS_NAMESPACE(rb_write_from_fd)
+#define rb_read_to_fd                  SYSUTILS_CUTILS_NAMESPACE(rb_read_to_fd)
+#define rb_write_acquire               SYSUTILS_CUTILS_NAMESPACE(rb_write_acquire)
+#define rb_write_commit                SYSUTILS_CUTILS_NAMESPACE(rb_write_commit)
+#define rb_read_acquire                SYSUTILS_CUTILS_NAMESPACE(rb_read_acquire)
+#define rb_read_release                SYSUTILS_CUTILS_NAMESPACE(rb_read_release)
 #define rb_done_write                  SYSUTILS_CUTILS_NAMESPACE(rb_done_write)
 #define rb_done_read                   SYSUTILS_CUTILS_NAMESPACE(rb_done_read)
 #define rb_unblock_reader              SYSUTILS_CUTILS_NAMESPACE(rb_unblock_reader)
 #define rb_set_threshold               SYSUTILS_CUTILS_NAMESPACE(rb_set_threshold)
 #define rb_get_threshold               SYSUTILS_CUTILS_NAMESPACE(rb_get_threshold)
+#define rb_set_write_threshold         SYSUTILS_CUTILS_NAMESPACE(rb_set_write_threshold)
+#define rb_get_write_threshold         SYSUTILS_CUTILS_NAMESPACE(rb_get_write_threshold)
 #define rb_reach_threshold             SYSUTILS_CUTILS_NAMESPACE(rb_reach_threshold)
 #define rb_is_full                     SYSUTILS_CUTILS_NAMESPACE(rb_is_full)
 #define rb_is_done_write               SYSUTILS_CUTILS_NAMESPACE(rb_is_done_write)
 
+// broadcast_ringbuf.h
+#define brb_create                     SYSUTILS_CUTILS_NAMESPACE(brb_create)
+#define brb_destroy                    SYSUTILS_CUTILS_NAMESPACE(brb_destroy)
+#define brb_add_reader                 SYSUTILS_CUTILS_NAMESPACE(brb_add_reader)
+#define brb_remove_reader              SYSUTILS_CUTILS_NAMESPACE(brb_remove_reader)
+#define brb_write                      SYSUTILS_CUTILS_NAMESPACE(brb_write)
+#define brb_done_write                 SYSUTILS_CUTILS_NAMESPACE(brb_done_write)
+#define brb_abort                      SYSUTILS_CUTILS_NAMESPACE(brb_abort)
+#define brb_reset                      SYSUTILS_CUTILS_NAMESPACE(brb_reset)
+#define brb_get_size                   SYSUTILS_CUTILS_NAMESPACE(brb_get_size)
+#define brb_bytes_available            SYSUTILS_CUTILS_NAMESPACE(brb_bytes_available)
+#define brb_read                       SYSUTILS_CUTILS_NAMESPACE(brb_read)
+#define brb_reader_bytes_filled        SYSUTILS_CUTILS_NAMESPACE(brb_reader_bytes_filled)
+#define brb_reader_set_threshold       SYSUTILS_CUTILS_NAMESPACE(brb_reader_set_threshold)
+#define brb_reader_abort               SYSUTILS_CUTILS_NAMESPACE(brb_reader_abort)
+#define brb_reader_done                SYSUTILS_CUTILS_NAMESPACE(brb_reader_done)
+#define brb_reader_dropped             SYSUTILS_CUTILS_NAMESPACE(brb_reader_dropped)
+
 // swtimer.h
 #define swtimer_create                 SYSUTILS_CUTILS_NAMESPACE(swtimer_create)
 #define swtimer_start                  SYSUTILS_CUTILS_NAMESPACE(swtimer_start)
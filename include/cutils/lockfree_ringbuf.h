@@ -17,6 +17,20 @@
 #ifndef __LOCKFREE_RINGBUF_H__
 #define __LOCKFREE_RINGBUF_H__
 
+#include <stddef.h>
+#include "osal/os_common.h"
+
+#if !defined(OS_RTOS)
+#include <sys/uio.h>
+#elif !defined(SYSUTILS_HAVE_IOVEC)
+#define SYSUTILS_HAVE_IOVEC 1
+// RTOS libc may lack <sys/uio.h>, define the same layout for readv/writev
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -25,10 +39,20 @@ enum {
     LOCKFREE_RINGBUF_NO_ERROR = 0,
     LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER = -1,
     LOCKFREE_RINGBUF_ERROR_INSUFFICIENT_WRITEABLE_BUFFER = -2,
+    LOCKFREE_RINGBUF_DONE = -3,
+    LOCKFREE_RINGBUF_ABORT = -4,
+    LOCKFREE_RINGBUF_TIMEOUT = -5,
+    LOCKFREE_RINGBUF_ERROR_IO = -6,
 };
 
 void *lockfree_ringbuf_create(int size);
 
+// lockfree_ringbuf_create_mirrored:
+//   Same as lockfree_ringbuf_create(), but map buffer twice back-to-back in
+//   virtual memory, so read and write never split on wraparound. Fallback to
+//   normal buffer if mapping fails
+void *lockfree_ringbuf_create_mirrored(int size);
+
 void lockfree_ringbuf_destroy(void *handle);
 
 int lockfree_ringbuf_get_size(void *handle);
@@ -47,6 +71,52 @@ int lockfree_ringbuf_write(void *handle, char *buf, int len);
 
 int lockfree_ringbuf_read(void *handle, char *buf, int len);
 
+// lockfree_ringbuf_writev:
+//   Gather @iovcnt buffers and write them as a whole, reader never sees part
+//   of them. Return LOCKFREE_RINGBUF_ERROR_INSUFFICIENT_WRITEABLE_BUFFER if
+//   there isn't enough space for all of them
+int lockfree_ringbuf_writev(void *handle, const struct iovec *iov, int iovcnt);
+
+// lockfree_ringbuf_readv:
+//   Read at most total length of @iov and scatter into @iovcnt buffers in
+//   order, return bytes read
+int lockfree_ringbuf_readv(void *handle, const struct iovec *iov, int iovcnt);
+
+#if !defined(OS_RTOS)
+// lockfree_ringbuf_write_from_fd:
+//   Read at most @len bytes from @fd into ringbuf directly, without waiting.
+//   Return bytes read, 0 if end of file, LOCKFREE_RINGBUF_ERROR_IO if read
+//   failed (check errno). Not available on RTOS
+int lockfree_ringbuf_write_from_fd(void *handle, int fd, int len);
+
+// lockfree_ringbuf_read_to_fd:
+//   Write at most @len bytes from ringbuf to @fd directly, without waiting.
+//   Return bytes written, LOCKFREE_RINGBUF_ERROR_IO if write failed (check
+//   errno). Not available on RTOS
+int lockfree_ringbuf_read_to_fd(void *handle, int fd, int len);
+#endif
+
+// lockfree_ringbuf_read_wait:
+//   Read @len bytes, wait at most @timeout_ms (forever if zero) in total if
+//   there isn't enough data, same as rb_read(). Only one reader is allowed.
+//   Return bytes read, or LOCKFREE_RINGBUF_DONE/ABORT/TIMEOUT if nothing read
+int lockfree_ringbuf_read_wait(void *handle, char *buf, int len, unsigned int timeout_ms);
+
+// lockfree_ringbuf_write_wait:
+//   Write @len bytes, wait at most @timeout_ms (forever if zero) in total if
+//   there isn't enough space, same as rb_write(). Multiple writers are
+//   serialized with each other, but must not mix with lockfree_ringbuf_write()
+int lockfree_ringbuf_write_wait(void *handle, char *buf, int len, unsigned int timeout_ms);
+
+// lockfree_ringbuf_done_write:
+//   Mark no more data will be written, reader gets LOCKFREE_RINGBUF_DONE after
+//   all data is read, until lockfree_ringbuf_unsafe_reset()
+void lockfree_ringbuf_done_write(void *handle);
+
+// lockfree_ringbuf_abort:
+//   Abort blocking read and write, until lockfree_ringbuf_unsafe_reset()
+void lockfree_ringbuf_abort(void *handle);
+
 #ifdef __cplusplus
 }
 #endif
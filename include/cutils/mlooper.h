@@ -84,20 +84,121 @@ void message_set_handle_cb(struct message *msg, message_cb on_handle);
 void message_set_free_cb(struct message *msg, message_cb on_free);
 void message_set_discard_cb(struct message *msg, message_cb on_discard);
 void message_set_timeout_cb(struct message *msg, message_cb on_timeout, unsigned long timeout_ms);
+// message_set_result:
+//   Called by handler to pass a result to mlooper_send_message_sync() caller,
+//   does nothing if the message was posted
+void message_set_result(struct message *msg, int result);
+
+enum mlooper_flag {
+    // Immediate messages (mlooper_post_message) are pushed to a lock-free
+    // multi-producer queue instead of taking the looper mutex, and looper
+    // thread is signaled only if it is sleeping. Useful if many threads
+    // feed a single looper. Ignored if atomic isn't supported
+    MLOOPER_FLAG_LOCKFREE_POST = 0x01,
+    // Collect latency/handling histograms and queue depth, see mlooper_get_stats()
+    MLOOPER_FLAG_STATS = 0x02,
+};
+
+struct mlooper_attr {
+    struct os_thread_attr thread_attr;
+    unsigned int flags;         // bitmask of enum mlooper_flag
+    unsigned int pool_capacity; // max message nodes cached by looper, 0: no node pool
+    unsigned int batch_size;    // max due messages taken from queue per lock acquisition, 0: one by one.
+                                // Messages of a taken batch can't be removed any more
+    unsigned int index_buckets; // buckets of a hashed index by message what, rounded up to power of 2,
+                                // mlooper_remove_message(what) only visits matched messages if set.
+                                // 0: no index, removing always scans the whole queue
+};
 
 mlooper_handle mlooper_create(struct os_thread_attr *attr, message_cb on_handle, message_cb on_free);
+mlooper_handle mlooper_create_with_attr(struct mlooper_attr *attr, message_cb on_handle, message_cb on_free);
 void mlooper_destroy(mlooper_handle looper);
 
+// mlooper_message_obtain/mlooper_message_obtain_buffer_obtain:
+//   Same as message_obtain()/message_obtain_buffer_obtain(), but recycle
+//   message node from node pool of the looper, see mlooper_attr.pool_capacity.
+//   Buffer larger than 256 bytes isn't pooled.
+//   Note that message obtained from the pool must be posted to the same
+//   looper, and the looper can't be destroyed before all of them are freed
+struct message *mlooper_message_obtain(mlooper_handle looper, int what, int arg1, int arg2, void *data);
+struct message *mlooper_message_obtain_buffer_obtain(mlooper_handle looper,
+                                                     int what, int arg1, int arg2, unsigned int size);
+
 int mlooper_start(mlooper_handle looper);
 void mlooper_stop(mlooper_handle looper);
 
 unsigned int mlooper_message_count(mlooper_handle looper);
 void mlooper_dump(mlooper_handle looper);
 
+#define MLOOPER_STATS_BUCKET_COUNT  24 // buckets[i]: [2^i, 2^(i+1)) usec, buckets[0] also counts 0,
+                                       // the last one counts everything above
+#define MLOOPER_STATS_WHAT_COUNT    16 // messages with more distinct @what only count in total
+
+struct mlooper_histogram {
+    unsigned long long count;
+    unsigned long long sum_usec;
+    unsigned long long max_usec;
+    unsigned int buckets[MLOOPER_STATS_BUCKET_COUNT];
+};
+
+struct mlooper_message_stats {
+    int what;
+    struct mlooper_histogram latency;  // from the time message should be handled to dispatching
+    struct mlooper_histogram handling; // execution time of handler
+    unsigned long long timeout_count;
+    unsigned long long discard_count;
+};
+
+struct mlooper_stats {
+    unsigned int max_depth;            // queue depth is sampled when message is posted
+    unsigned long long depth_sum;
+    unsigned long long depth_samples;
+    struct mlooper_message_stats total;
+    unsigned int what_count;
+    struct mlooper_message_stats per_what[MLOOPER_STATS_WHAT_COUNT];
+};
+
+// mlooper_add_idle_handler:
+//   Call @on_idle on looper thread when no message is due, that is the queue
+//   is empty or the first message is delayed. Handlers run once each time the
+//   looper becomes idle, a handler that returns false is removed
+int mlooper_add_idle_handler(mlooper_handle looper, bool (*on_idle)(void *arg), void *arg);
+int mlooper_remove_idle_handler(mlooper_handle looper, bool (*on_idle)(void *arg), void *arg);
+
+// mlooper_get_stats:
+//   Copy a snapshot of looper stats, return -1 if MLOOPER_FLAG_STATS isn't set
+int mlooper_get_stats(mlooper_handle looper, struct mlooper_stats *stats);
+void mlooper_reset_stats(mlooper_handle looper);
+
 int mlooper_post_message(mlooper_handle looper, struct message *msg);
 int mlooper_post_message_front(mlooper_handle looper, struct message *msg);
 int mlooper_post_message_delay(mlooper_handle looper, struct message *msg, unsigned long msec);
 
+// mlooper_send_message_sync:
+//   Post the message and block until it is handled, @result gets the value
+//   that handler set with message_set_result(), 0 if not set.
+//   Return 0 if handled, -1 if the message is discarded or timed out, or if
+//   looper isn't started. If called from the looper thread, the message is
+//   handled inline.
+//   Caller sleeps on a waiter kept per thread, so no OS object is created per call
+int mlooper_send_message_sync(mlooper_handle looper, struct message *msg, int *result);
+
+enum mlooper_coalesce_policy {
+    MLOOPER_COALESCE_REPLACE,  // the new message takes the place and schedule of the pending one,
+                               // or its own schedule if it would time out before that
+    MLOOPER_COALESCE_DROP_NEW, // the pending message is kept, the new one is discarded
+};
+
+// mlooper_post_message_coalesce:
+//   Post the message @msec later only if no message with the same msg->what
+//   is pending, otherwise resolve the two according to @policy. The message
+//   that loses is freed with on_discard. Lookup is O(1) if index_buckets of
+//   mlooper_attr is set, otherwise it scans the queue.
+//   Return 0 if posted or replaced, 1 if dropped by MLOOPER_COALESCE_DROP_NEW,
+//   -1 if failed
+int mlooper_post_message_coalesce(mlooper_handle looper, struct message *msg, unsigned long msec,
+                                  enum mlooper_coalesce_policy policy);
+
 // mlooper_remove_self_message:
 //   Will check owner thread of the message, can't remove if not matched
 int mlooper_remove_self_message(mlooper_handle looper, int what);
@@ -110,6 +211,38 @@ int mlooper_remove_message(mlooper_handle looper, int what);
 int mlooper_remove_message_if(mlooper_handle looper, bool (*on_match)(struct message *msg));
 int mlooper_clear_message(mlooper_handle looper);
 
+/*
+ * mlooper_pool:
+ *   A group of looper threads that handle messages posted to the pool, so a
+ *   slow handler only blocks its own worker. Messages and callbacks are the
+ *   same as mlooper, handlers can move from a looper to a pool unchanged.
+ *
+ *   - mlooper_pool_post_message: the message goes to an idle worker if any,
+ *     and can be stolen by another worker that runs out of messages.
+ *     There is no ordering between plain messages.
+ *   - mlooper_pool_post_message_delay: the message is handled by the worker
+ *     picked at posting time, it's never stolen.
+ *   - mlooper_pool_post_affinity_message: messages with the same @key are
+ *     handled by the same worker, one by one in posting order.
+ */
+typedef struct mlooper_pool *mlooper_pool_handle;
+
+mlooper_pool_handle mlooper_pool_create(struct os_thread_attr *attr, unsigned int thread_count,
+                                        message_cb on_handle, message_cb on_free);
+void mlooper_pool_destroy(mlooper_pool_handle pool);
+
+int mlooper_pool_start(mlooper_pool_handle pool);
+void mlooper_pool_stop(mlooper_pool_handle pool);
+
+unsigned int mlooper_pool_message_count(mlooper_pool_handle pool);
+void mlooper_pool_dump(mlooper_pool_handle pool);
+
+int mlooper_pool_post_message(mlooper_pool_handle pool, struct message *msg);
+int mlooper_pool_post_message_delay(mlooper_pool_handle pool, struct message *msg, unsigned long msec);
+int mlooper_pool_post_affinity_message(mlooper_pool_handle pool, struct message *msg, unsigned long key);
+
+int mlooper_pool_remove_message(mlooper_pool_handle pool, int what);
+
 #ifdef __cplusplus
 }
 #endif
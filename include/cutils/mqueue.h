@@ -30,6 +30,35 @@ typedef struct mqueue *mqset_handle;
 
 mq_handle mqueue_create(unsigned int msg_size, unsigned int msg_count);
 
+// mqueue_create_on_node:
+//   Same as mqueue_create(), but msg buffer prefers NUMA @node, pass the node
+//   where senders and receivers run. Fallback to normal buffer if NUMA
+//   placement isn't supported
+mq_handle mqueue_create_on_node(unsigned int msg_size, unsigned int msg_count, int node);
+
+// mqueue_create_lockfree:
+//   Create a queue that senders and receivers access without lock, useful
+//   if there are many concurrent senders. Threads only block on mutex/cond
+//   when queue is full or empty. @msg_count is rounded up to power of 2.
+//   Note that lock-free queue can't be added to a queue set, and that
+//   mqueue_reset() and mqueue_count_*() aren't exact if queue is in use.
+//   Fallback to mqueue_create() if atomic isn't supported
+mq_handle mqueue_create_lockfree(unsigned int msg_size, unsigned int msg_count);
+
+// mqueue_create_prio:
+//   Create a queue with @prio_count (at most 32) priority lanes sharing
+//   @msg_count slots, higher value means higher priority. mqueue_receive()
+//   returns the oldest msg of the highest non-empty lane, and mqueue_send()
+//   sends msg with priority 0. Batch and zero-copy APIs aren't supported
+mq_handle mqueue_create_prio(unsigned int msg_size, unsigned int msg_count, unsigned int prio_count);
+
+// mqueue_create_varlen:
+//   Create a queue of variable-length msgs, stored as length-prefixed records
+//   in a byte ring of @capacity bytes, each record takes extra 4 bytes.
+//   Use mqueue_send_varlen()/mqueue_receive_varlen() only, and note that
+//   mqueue_count_*() return bytes for this queue
+mq_handle mqueue_create_varlen(unsigned int capacity);
+
 int mqueue_destroy(mq_handle queue);
 
 int mqueue_reset(mq_handle queue);
@@ -38,6 +67,55 @@ int mqueue_send(mq_handle queue, char *msg, unsigned long timeout_ms);
 
 int mqueue_receive(mq_handle queue, char *msg, unsigned long timeout_ms);
 
+// mqueue_send_prio:
+//   Send msg to lane @prio of a priority queue, @prio must be 0 for other
+//   queues including lock-free queue, otherwise -1 is returned
+int mqueue_send_prio(mq_handle queue, char *msg, unsigned int prio, unsigned long timeout_ms);
+
+// mqueue_send_varlen:
+//   Send @len bytes as one record, wait at most @timeout_ms until there is room
+int mqueue_send_varlen(mq_handle queue, const char *msg, unsigned int len, unsigned long timeout_ms);
+
+// mqueue_receive_varlen:
+//   Receive one record into @buf of @size bytes, wait at most @timeout_ms if
+//   queue is empty. Return length of the record, -1 if timeout or @size is
+//   smaller than the record, which is kept in queue in that case
+int mqueue_receive_varlen(mq_handle queue, char *buf, unsigned int size, unsigned long timeout_ms);
+
+// mqueue_send_batch:
+//   Send at most @count msgs stored contiguously in @msgs, wait at most
+//   @timeout_ms if queue is full. Return number of sent msgs, -1 if none sent
+int mqueue_send_batch(mq_handle queue, const char *msgs, unsigned int count, unsigned long timeout_ms);
+
+// mqueue_receive_batch:
+//   Receive at most @count msgs into @msgs, wait at most @timeout_ms if queue
+//   is empty. Return number of received msgs, -1 if none received
+int mqueue_receive_batch(mq_handle queue, char *msgs, unsigned int count, unsigned long timeout_ms);
+
+// mqueue_send_reserve:
+//   Reserve a slot to fill msg in place, wait at most @timeout_ms if queue is full.
+//   Return pointer to the slot that is @msg_size bytes, NULL if timeout.
+//   The msg isn't visible to receivers until mqueue_send_commit() is called.
+//   For locked queue, only one slot can be reserved at a time, other senders
+//   wait until the slot is committed
+char *mqueue_send_reserve(mq_handle queue, unsigned long timeout_ms);
+
+// mqueue_send_commit:
+//   Commit the slot returned by mqueue_send_reserve()
+int mqueue_send_commit(mq_handle queue, char *slot);
+
+// mqueue_receive_peek:
+//   Get the oldest msg in place, wait at most @timeout_ms if queue is empty.
+//   Return pointer to the slot, NULL if timeout. The slot can't be reused by
+//   senders until mqueue_receive_release() is called.
+//   For locked queue, only one slot can be peeked at a time, other receivers
+//   wait until the slot is released
+char *mqueue_receive_peek(mq_handle queue, unsigned long timeout_ms);
+
+// mqueue_receive_release:
+//   Release the slot returned by mqueue_receive_peek()
+int mqueue_receive_release(mq_handle queue, char *slot);
+
 unsigned int mqueue_count_available(mq_handle queue);
 
 unsigned int mqueue_count_filled(mq_handle queue);
@@ -64,15 +142,20 @@ unsigned int mqueue_count_filled(mq_handle queue);
  * on a member of a queue set unless a call to mqueueset_select_queue() has first
  * returned a handle to that set member.
  *
- * Note 3:  @msg_count specifies the maximum number of events that can be queued
- * at once. To be absolutely certain that events are not lost @msg_count should
- * be set to the total sum of the length of the queues added to the set.
+ * Note 3:  A set tracks readiness rather than events: a member queue is linked
+ * to the ready list of the set while it isn't empty, and the set lock is only
+ * taken when a member becomes empty or non-empty. So events are never lost,
+ * and each member counts as one unit of @msg_count whatever its length, so
+ * @msg_count only bounds the number of member queues. A queue stays ready
+ * until it's drained, mqueueset_select_queue() returns ready queues in
+ * round-robin order.
  *
  * Note 4:  If the queue could not be successfully added to the queue set because
- * it is already a member of a different queue set.
+ * it is already a member of a different queue set, it's a lock-free queue, or
+ * the set already has @msg_count member queues.
  *
  * Note 5:  If the queue could not be successfully remove from the queue set
- * because it is not in the queue set, or the queue is not empty.
+ * because it is not in the queue set.
  *
  * Usage example:
  *
@@ -80,8 +163,7 @@ unsigned int mqueue_count_filled(mq_handle queue);
  * queue1 = mqueue_create(ITEM_SIZE_QUEUE_1, QUEUE_LENGTH_1);
  * queue2 = mqueue_create(ITEM_SIZE_QUEUE_2, QUEUE_LENGTH_2);
  *
- * // Create the queue set large enough to hold an event for every space
- * // in every queue that is to be added to the set.
+ * // Create the queue set.
  * queueset = mqueueset_create(QUEUE_LENGTH_1 + QUEUE_LENGTH_2);
  *
  * // Add the queues to the set. Reading from these queues can only be
@@ -109,6 +191,9 @@ unsigned int mqueue_count_filled(mq_handle queue);
  * }
  *
  */
+// mqueueset_create:
+//   Create a set of at most @msg_count member queues, each member counts as
+//   one whatever its length or kind
 mqset_handle mqueueset_create(unsigned int msg_count);
 
 int mqueueset_destroy(mqset_handle set);
@@ -119,6 +204,12 @@ int mqueueset_remove_queue(mqset_handle set, mq_handle queue);
 
 mq_handle mqueueset_select_queue(mqset_handle set, unsigned long timeout_ms);
 
+// mqueueset_select_queues:
+//   Store at most @count ready queues to @queues, wait at most @timeout_ms if
+//   no queue is ready. Return number of ready queues, -1 if timeout
+int mqueueset_select_queues(mqset_handle set, mq_handle *queues, unsigned int count,
+                            unsigned long timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
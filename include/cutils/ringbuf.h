@@ -30,8 +30,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "osal/os_common.h"
 #include "cutil_namespace.h"
 
+#if !defined(OS_RTOS)
+#include <sys/uio.h>
+#elif !defined(SYSUTILS_HAVE_IOVEC)
+#define SYSUTILS_HAVE_IOVEC 1
+// RTOS libc may lack <sys/uio.h>, define the same layout for readv/writev
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -44,6 +56,12 @@ extern "C" {
 
 typedef struct ringbuf *ringbuf_handle;
 
+// Contiguous span inside ringbuffer, see rb_read_acquire()/rb_write_acquire()
+struct rb_region {
+    char *buf;
+    int   len;
+};
+
 /**
  * @brief      Create ringbuffer
  *
@@ -53,6 +71,29 @@ typedef struct ringbuf *ringbuf_handle;
  */
 ringbuf_handle rb_create(int size);
 
+/**
+ * @brief      Create ringbuffer whose buffer is mapped twice back-to-back in virtual memory, so data
+ *             never wraps around: rb_read_acquire()/rb_write_acquire() always return a single region.
+ *             Size is rounded up to multiple of page size. Fallback to rb_create() if mapping fails
+ *
+ * @param[in]  size   Size of ringbuffer
+ *
+ * @return     ringbuf_handle
+ */
+ringbuf_handle rb_create_mirrored(int size);
+
+/**
+ * @brief      Create ringbuffer whose buffer prefers NUMA @node, pass the node where reader and
+ *             writer threads run so data doesn't cross the interconnect. Fallback to rb_create()
+ *             if NUMA placement isn't supported
+ *
+ * @param[in]  size   Size of ringbuffer
+ * @param[in]  node   NUMA node to place the buffer
+ *
+ * @return     ringbuf_handle
+ */
+ringbuf_handle rb_create_on_node(int size, int node);
+
 /**
  * @brief      Cleanup and free all memory created by ringbuf_handle
  *
@@ -75,7 +116,7 @@ void rb_abort(ringbuf_handle rb);
 void rb_reset(ringbuf_handle rb);
 
 /**
- * @brief      Get total bytes available of Ringbuffer
+ * @brief      Get total bytes available of Ringbuffer, zero while a write region is acquired
  *
  * @param[in]  rb    The Ringbuffer handle
  *
@@ -151,6 +192,116 @@ int rb_read_chunk(ringbuf_handle rb, char *buf, int size, unsigned int timeout_m
  */
 int rb_write_chunk(ringbuf_handle rb, char *buf, int size, unsigned int timeout_ms);
 
+/**
+ * @brief      Read chunk from Ringbuffer to `iov` as a whole, same as rb_read_chunk() but scatter data
+ *             into `iovcnt` buffers.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param      iov            The buffers to read out data
+ * @param[in]  iovcnt         The number of buffers
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Number of bytes read
+ */
+int rb_readv(ringbuf_handle rb, const struct iovec *iov, int iovcnt, unsigned int timeout_ms);
+
+/**
+ * @brief      Write chunk to Ringbuffer from `iov` as a whole, same as rb_write_chunk() but gather data
+ *             from `iovcnt` buffers, so data from other writers never interleaves with it.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param      iov            The buffers
+ * @param[in]  iovcnt         The number of buffers
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Number of bytes written
+ */
+int rb_writev(ringbuf_handle rb, const struct iovec *iov, int iovcnt, unsigned int timeout_ms);
+
+/**
+ * @brief      Acquire up to `size` bytes of free space of Ringbuffer for writing in place, wait `timeout_ms`
+ *             milliseconds until there is some space. Free space is returned as up to two contiguous regions,
+ *             region[1].len is zero if free space doesn't wrap around. Data written to regions becomes readable
+ *             after rb_write_commit(). Only one write region can be out at a time, other writers and acquirers
+ *             wait until it's committed, so the acquiring thread mustn't write by itself in between.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] region         The two regions of acquired space
+ * @param[in]  size           The length request
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Number of bytes acquired, or RB_FAIL/RB_DONE/RB_ABORT/RB_TIMEOUT
+ */
+int rb_write_acquire(ringbuf_handle rb, struct rb_region region[2], int size, unsigned int timeout_ms);
+
+/**
+ * @brief      Commit `len` bytes written to the region acquired by rb_write_acquire(), the rest of acquired
+ *             space is given back
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[in]  len            The length written, no more than acquired
+ *
+ * @return     RB_OK or RB_FAIL
+ */
+int rb_write_commit(ringbuf_handle rb, int len);
+
+/**
+ * @brief      Acquire up to `size` bytes of filled data of Ringbuffer for reading in place, wait `timeout_ms`
+ *             milliseconds until there is some data. Data is returned as up to two contiguous regions,
+ *             region[1].len is zero if data doesn't wrap around. Data is kept in Ringbuffer until
+ *             rb_read_release(). Only one read region can be out at a time, other readers and acquirers wait
+ *             until it's released, so the acquiring thread mustn't read by itself in between.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] region         The two regions of acquired data
+ * @param[in]  size           The length request
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Number of bytes acquired, or RB_FAIL/RB_DONE/RB_ABORT/RB_TIMEOUT
+ */
+int rb_read_acquire(ringbuf_handle rb, struct rb_region region[2], int size, unsigned int timeout_ms);
+
+/**
+ * @brief      Release `len` bytes consumed from the region acquired by rb_read_acquire(), the rest of
+ *             acquired data is kept in Ringbuffer
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[in]  len            The length consumed, no more than acquired
+ *
+ * @return     RB_OK or RB_FAIL
+ */
+int rb_read_release(ringbuf_handle rb, int len);
+
+#if !defined(OS_RTOS)
+/**
+ * @brief      Read up to `len` bytes from file descriptor `fd` into Ringbuffer directly, wait `timeout_ms`
+ *             milliseconds until there is some space. Built on rb_write_acquire()/rb_write_commit(), not
+ *             available on RTOS
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[in]  fd             The file descriptor
+ * @param[in]  len            The length request
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Number of bytes read from `fd`, 0 if end of file, or RB_FAIL/RB_DONE/RB_ABORT/RB_TIMEOUT
+ */
+int rb_write_from_fd(ringbuf_handle rb, int fd, int len, unsigned int timeout_ms);
+
+/**
+ * @brief      Write up to `len` bytes from Ringbuffer to file descriptor `fd` directly, wait `timeout_ms`
+ *             milliseconds until there is some data. Built on rb_read_acquire()/rb_read_release(), not
+ *             available on RTOS
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[in]  fd             The file descriptor
+ * @param[in]  len            The length request
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Number of bytes written to `fd`, or RB_FAIL/RB_DONE/RB_ABORT/RB_TIMEOUT
+ */
+int rb_read_to_fd(ringbuf_handle rb, int fd, int len, unsigned int timeout_ms);
+#endif
+
 /**
  * @brief      Set status of writing to ringbuffer is done
  *
@@ -186,6 +337,20 @@ void rb_set_threshold(ringbuf_handle rb, int threshold);
  */
 int rb_get_threshold(ringbuf_handle rb);
 
+/**
+ * @brief      Set writer threshold, blocked writer is woken up only when free space reaches it
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ */
+void rb_set_write_threshold(ringbuf_handle rb, int threshold);
+
+/**
+ * @brief      Get writer threshold
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ */
+int rb_get_write_threshold(ringbuf_handle rb);
+
 /**
  * @brief      Check whether reader reach threshold
  *
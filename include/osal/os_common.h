@@ -57,4 +57,21 @@
 #endif
 #endif
 
+/* cache line size, data written by different threads is kept this far apart */
+#if !defined(OS_CACHELINE_SIZE)
+#if defined(OS_APPLE) && defined(__aarch64__)
+#define OS_CACHELINE_SIZE 128
+#else
+#define OS_CACHELINE_SIZE 64
+#endif
+#endif
+
+/* pad struct member @name so @used bytes before it plus padding fill a cache line,
+ * define SYSUTILS_HAVE_CACHELINE_PAD_DISABLED to drop padding and measure false sharing */
+#if defined(SYSUTILS_HAVE_CACHELINE_PAD_DISABLED)
+#define OS_CACHELINE_PAD(name, used)
+#else
+#define OS_CACHELINE_PAD(name, used) char name[OS_CACHELINE_SIZE - (used)];
+#endif
+
 #endif // __SYSUTILS_OS_COMMON_H__
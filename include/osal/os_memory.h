@@ -36,6 +36,26 @@ void os_free(void *ptr);
 
 char *os_strdup(const char *str);
 
+// os_mirror_granularity:
+//   Return the unit that size of os_mirror_alloc() must be a multiple of,
+//   zero if mirrored memory isn't supported
+unsigned int os_mirror_granularity(void);
+
+// os_mirror_alloc:
+//   Allocate @size bytes and map them twice back-to-back, so p[i] and
+//   p[i + size] are the same byte. Return NULL if failed
+void *os_mirror_alloc(unsigned int size);
+
+void os_mirror_free(void *ptr, unsigned int size);
+
+// os_node_alloc:
+//   Allocate @size zeroed bytes whose pages prefer NUMA node @node, kernel
+//   falls back to other nodes if @node is out of memory. Return NULL if
+//   NUMA placement isn't supported, free with os_node_free()
+void *os_node_alloc(unsigned int size, int node);
+
+void os_node_free(void *ptr, unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif
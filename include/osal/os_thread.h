@@ -30,6 +30,7 @@ extern "C" {
 typedef void * os_thread;
 typedef void * os_mutex;
 typedef void * os_cond;
+typedef void * os_thread_key;
 
 enum os_thread_prio {
     OS_THREAD_PRIO_REALTIME,
@@ -61,10 +62,36 @@ void os_mutex_destroy(os_mutex mutex);
 os_cond os_cond_create();
 int os_cond_wait(os_cond cond, os_mutex mutex);
 int os_cond_timedwait(os_cond cond, os_mutex mutex, unsigned long usec);
+// os_cond_timedwait_until:
+//   Wait until @deadline_usec, which is an absolute time of os_monotonic_usec().
+//   Return 0 if woken up (maybe spuriously), non-zero if deadline is reached.
+//   Callers re-check their condition in a loop with the same deadline, so the
+//   total wait never exceeds the timeout no matter how often they are woken
+int os_cond_timedwait_until(os_cond cond, os_mutex mutex, unsigned long long deadline_usec);
 int os_cond_signal(os_cond cond);
 int os_cond_broadcast(os_cond cond);
 void os_cond_destroy(os_cond cond);
 
+// os_mutex_init/os_cond_init:
+//   Construct mutex/cond in @storage of os_mutex_storage_size()/
+//   os_cond_storage_size() bytes, aligned as malloc() does. So they can be
+//   embedded in the allocation of their owner instead of a separate one.
+//   Use os_mutex_deinit()/os_cond_deinit() instead of *_destroy() on them
+unsigned int os_mutex_storage_size();
+os_mutex os_mutex_init(void *storage);
+void os_mutex_deinit(os_mutex mutex);
+unsigned int os_cond_storage_size();
+os_cond os_cond_init(void *storage);
+void os_cond_deinit(os_cond cond);
+
+// os_thread_key_create:
+//   Create a key for thread-specific values, @destructor is called with the
+//   value of the thread when it exits if the value isn't NULL
+os_thread_key os_thread_key_create(void (*destructor)(void *value));
+int os_thread_key_set(os_thread_key key, void *value);
+void *os_thread_key_get(os_thread_key key);
+void os_thread_key_delete(os_thread_key key);
+
 void os_thread_sleep_usec(unsigned long usec);
 void os_thread_sleep_msec(unsigned long msec);
 
@@ -41,6 +41,11 @@
 #define os_realloc                     SYSUTILS_OSAL_NAMESPACE(os_realloc)
 #define os_free                        SYSUTILS_OSAL_NAMESPACE(os_free)
 #define os_strdup                      SYSUTILS_OSAL_NAMESPACE(os_strdup)
+#define os_mirror_granularity          SYSUTILS_OSAL_NAMESPACE(os_mirror_granularity)
+#define os_mirror_alloc                SYSUTILS_OSAL_NAMESPACE(os_mirror_alloc)
+#define os_mirror_free                 SYSUTILS_OSAL_NAMESPACE(os_mirror_free)
+#define os_node_alloc                  SYSUTILS_OSAL_NAMESPACE(os_node_alloc)
+#define os_node_free                   SYSUTILS_OSAL_NAMESPACE(os_node_free)
 
 // os_misc.h
 #define os_random                      SYSUTILS_OSAL_NAMESPACE(os_random)
@@ -59,9 +64,20 @@
 #define os_cond_create                 SYSUTILS_OSAL_NAMESPACE(os_cond_create)
 #define os_cond_wait                   SYSUTILS_OSAL_NAMESPACE(os_cond_wait)
 #define os_cond_timedwait              SYSUTILS_OSAL_NAMESPACE(os_cond_timedwait)
+#define os_cond_timedwait_until        SYSUTILS_OSAL_NAMESPACE(os_cond_timedwait_until)
 #define os_cond_signal                 SYSUTILS_OSAL_NAMESPACE(os_cond_signal)
 #define os_cond_broadcast              SYSUTILS_OSAL_NAMESPACE(os_cond_broadcast)
 #define os_cond_destroy                SYSUTILS_OSAL_NAMESPACE(os_cond_destroy)
+#define os_mutex_storage_size          SYSUTILS_OSAL_NAMESPACE(os_mutex_storage_size)
+#define os_mutex_init                  SYSUTILS_OSAL_NAMESPACE(os_mutex_init)
+#define os_mutex_deinit                SYSUTILS_OSAL_NAMESPACE(os_mutex_deinit)
+#define os_cond_storage_size           SYSUTILS_OSAL_NAMESPACE(os_cond_storage_size)
+#define os_cond_init                   SYSUTILS_OSAL_NAMESPACE(os_cond_init)
+#define os_cond_deinit                 SYSUTILS_OSAL_NAMESPACE(os_cond_deinit)
+#define os_thread_key_create           SYSUTILS_OSAL_NAMESPACE(os_thread_key_create)
+#define os_thread_key_set              SYSUTILS_OSAL_NAMESPACE(os_thread_key_set)
+#define os_thread_key_get              SYSUTILS_OSAL_NAMESPACE(os_thread_key_get)
+#define os_thread_key_delete           SYSUTILS_OSAL_NAMESPACE(os_thread_key_delete)
 #define os_thread_sleep_usec           SYSUTILS_OSAL_NAMESPACE(os_thread_sleep_usec)
 #define os_thread_sleep_msec           SYSUTILS_OSAL_NAMESPACE(os_thread_sleep_msec)
 
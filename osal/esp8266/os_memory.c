@@ -41,3 +41,26 @@ char *os_strdup(const char *str)
 {
     return strdup(str);
 }
+
+unsigned int os_mirror_granularity(void)
+{
+    return 0;
+}
+
+void *os_mirror_alloc(unsigned int size)
+{
+    return NULL;
+}
+
+void os_mirror_free(void *ptr, unsigned int size)
+{
+}
+
+void *os_node_alloc(unsigned int size, int node)
+{
+    return NULL;
+}
+
+void os_node_free(void *ptr, unsigned int size)
+{
+}
@@ -16,8 +16,10 @@
 
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <time.h>
 #include <pthread.h>
+#include "osal/os_time.h"
 #include "osal/os_thread.h"
 
 #if defined(OS_FREERTOS_ESP8266) || defined(OS_FREERTOS_ESP32)
@@ -177,12 +179,30 @@ int os_thread_detach(os_thread thread)
     return pthread_detach((pthread_t)thread);
 }
 
+unsigned int os_mutex_storage_size()
+{
+    return sizeof(pthread_mutex_t);
+}
+
+os_mutex os_mutex_init(void *storage)
+{
+    pthread_mutex_t *mutex = (pthread_mutex_t *)storage;
+    if (pthread_mutex_init(mutex, NULL) != 0)
+        return NULL;
+    return (os_mutex)mutex;
+}
+
+void os_mutex_deinit(os_mutex mutex)
+{
+    pthread_mutex_destroy((pthread_mutex_t *)mutex);
+}
+
 os_mutex os_mutex_create()
 {
     pthread_mutex_t *mutex = calloc(1, sizeof(pthread_mutex_t));
     if (mutex == NULL)
         return NULL;
-    if (pthread_mutex_init(mutex, NULL) != 0) {
+    if (os_mutex_init(mutex) == NULL) {
         free(mutex);
         return NULL;
     }
@@ -206,15 +226,18 @@ int os_mutex_unlock(os_mutex mutex)
 
 void os_mutex_destroy(os_mutex mutex)
 {
-    pthread_mutex_destroy((pthread_mutex_t *)mutex);
+    os_mutex_deinit(mutex);
     free(mutex);
 }
 
-os_cond os_cond_create()
+unsigned int os_cond_storage_size()
 {
-    pthread_cond_t *cond = calloc(1, sizeof(pthread_cond_t));
-    if (cond == NULL)
-        return NULL;
+    return sizeof(pthread_cond_t);
+}
+
+os_cond os_cond_init(void *storage)
+{
+    pthread_cond_t *cond = (pthread_cond_t *)storage;
 #if defined(OS_FREERTOS_ESP8266) || defined(OS_FREERTOS_ESP32)
     // todo: pthread_condattr_setclock NOT supported yet
     int ret = pthread_cond_init(cond, NULL);
@@ -228,7 +251,22 @@ os_cond os_cond_create()
     pthread_condattr_destroy(&attr);
 #endif
 
-    if (ret != 0) {
+    if (ret != 0)
+        return NULL;
+    return (os_cond)cond;
+}
+
+void os_cond_deinit(os_cond cond)
+{
+    pthread_cond_destroy((pthread_cond_t *)cond);
+}
+
+os_cond os_cond_create()
+{
+    pthread_cond_t *cond = calloc(1, sizeof(pthread_cond_t));
+    if (cond == NULL)
+        return NULL;
+    if (os_cond_init(cond) == NULL) {
         free(cond);
         return NULL;
     }
@@ -257,6 +295,15 @@ int os_cond_timedwait(os_cond cond, os_mutex mutex, unsigned long usec)
     return pthread_cond_timedwait((pthread_cond_t *)cond, (pthread_mutex_t *)mutex, &ts);
 }
 
+int os_cond_timedwait_until(os_cond cond, os_mutex mutex, unsigned long long deadline_usec)
+{
+    // cond may be bound to CLOCK_REALTIME, convert deadline to relative time
+    unsigned long long now = os_monotonic_usec();
+    if (now >= deadline_usec)
+        return ETIMEDOUT;
+    return os_cond_timedwait(cond, mutex, (unsigned long)(deadline_usec - now));
+}
+
 int os_cond_signal(os_cond cond)
 {
     return pthread_cond_signal((pthread_cond_t *)cond);
@@ -269,10 +316,38 @@ int os_cond_broadcast(os_cond cond)
 
 void os_cond_destroy(os_cond cond)
 {
-    pthread_cond_destroy((pthread_cond_t *)cond);
+    os_cond_deinit(cond);
     free(cond);
 }
 
+os_thread_key os_thread_key_create(void (*destructor)(void *value))
+{
+    pthread_key_t *key = calloc(1, sizeof(pthread_key_t));
+    if (key == NULL)
+        return NULL;
+    if (pthread_key_create(key, destructor) != 0) {
+        free(key);
+        return NULL;
+    }
+    return (os_thread_key)key;
+}
+
+int os_thread_key_set(os_thread_key key, void *value)
+{
+    return pthread_setspecific(*(pthread_key_t *)key, value);
+}
+
+void *os_thread_key_get(os_thread_key key)
+{
+    return pthread_getspecific(*(pthread_key_t *)key);
+}
+
+void os_thread_key_delete(os_thread_key key)
+{
+    pthread_key_delete(*(pthread_key_t *)key);
+    free(key);
+}
+
 void os_thread_sleep_usec(unsigned long usec)
 {
     usleep(usec);
@@ -15,7 +15,24 @@
  */
 
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "osal/os_memory.h"
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <sys/syscall.h>
+#endif
+
+// memfd_create() wrapper isn't available in old glibc and bionic, so both
+// Linux and Android call the syscall directly
+#if (defined(OS_LINUX) || defined(OS_ANDROID)) && defined(__NR_memfd_create)
+#define OS_HAVE_MIRROR 1
+#endif
+
+// mbind() wrapper is in libnuma, call the syscall directly
+#if (defined(OS_LINUX) || defined(OS_ANDROID)) && defined(__NR_mbind)
+#define OS_HAVE_NODE_ALLOC 1
+#define OS_MPOL_PREFERRED  1
+#endif
 
 void *os_malloc(unsigned int size)
 {
@@ -41,3 +58,88 @@ char *os_strdup(const char *str)
 {
     return strdup(str);
 }
+
+unsigned int os_mirror_granularity(void)
+{
+#if defined(OS_HAVE_MIRROR)
+    long page_size = sysconf(_SC_PAGESIZE);
+    return page_size > 0 ? (unsigned int)page_size : 0;
+#else
+    return 0;
+#endif
+}
+
+void *os_mirror_alloc(unsigned int size)
+{
+#if defined(OS_HAVE_MIRROR)
+    unsigned int granularity = os_mirror_granularity();
+    char *base, *p1, *p2;
+    int fd;
+
+    if (granularity == 0 || size == 0 || size % granularity != 0)
+        return NULL;
+
+    fd = (int)syscall(__NR_memfd_create, "os_mirror", 0);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // reserve address space for both views, then map the file over it twice
+    base = mmap(NULL, (size_t)size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    p1 = mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    p2 = mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+    if (p1 != base || p2 != base + size) {
+        munmap(base, (size_t)size * 2);
+        return NULL;
+    }
+    return base;
+#else
+    return NULL;
+#endif
+}
+
+void os_mirror_free(void *ptr, unsigned int size)
+{
+    if (ptr != NULL)
+        munmap(ptr, (size_t)size * 2);
+}
+
+void *os_node_alloc(unsigned int size, int node)
+{
+#if defined(OS_HAVE_NODE_ALLOC)
+    unsigned long nodemask;
+    void *ptr;
+
+    if (size == 0 || node < 0 || node >= (int)(sizeof(nodemask) * 8))
+        return NULL;
+
+    // pages aren't faulted in until first touch, so the policy set here
+    // decides where they are placed
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+    nodemask = 1UL << node;
+    if (syscall(__NR_mbind, ptr, (unsigned long)size, OS_MPOL_PREFERRED,
+                &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+        munmap(ptr, size);
+        return NULL;
+    }
+    return ptr;
+#else
+    return NULL;
+#endif
+}
+
+void os_node_free(void *ptr, unsigned int size)
+{
+    if (ptr != NULL)
+        munmap(ptr, size);
+}
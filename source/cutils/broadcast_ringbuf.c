@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2023-, Qinglong<sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "osal/os_thread.h"
+#include "osal/os_time.h"
+#include "cutils/memory_helper.h"
+#include "cutils/log_helper.h"
+#include "cutils/list.h"
+#include "cutils/broadcast_ringbuf.h"
+
+#define LOG_TAG "broadcast_ringbuf"
+
+/*
+ * Positions are free-running byte counters, (pos % size) is the offset in
+ * buffer. Writer may write until it reaches (slowest read_pos + size), where
+ * readers with drop_if_slow and done or aborted readers aren't counted.
+ * Readers with drop_if_slow that fall more than size behind are moved
+ * forward, done or aborted readers are left behind and never read again.
+ * Everything is protected by rb->lock.
+ */
+struct broadcast_ringbuf {
+    char *buffer;
+    int  size;                   /**< Buffer size */
+    unsigned long long write_pos;
+    struct listnode readers;     /**< List of struct broadcast_ringbuf_reader */
+    os_mutex lock;
+    os_cond can_write;
+    int  write_waiters;          /**< Number of writers waiting on can_write */
+    bool is_done_write;          /**< To signal that we are done writing */
+    bool abort_write;
+};
+
+struct broadcast_ringbuf_reader {
+    struct listnode node;
+    brb_handle rb;
+    unsigned long long read_pos;
+    unsigned long long dropped;  /**< Bytes dropped for drop_if_slow reader */
+    os_cond can_read;
+    int  read_waiters;           /**< Number of threads waiting on can_read */
+    int  threshold_cnt;          /**< Number of threshold slots */
+    bool drop_if_slow;
+    bool is_reach_threshold;
+    bool abort_read;
+    bool is_done_read;
+};
+
+brb_handle brb_create(int size)
+{
+    brb_handle rb = NULL;
+    bool _success =
+        (
+            size > 0 &&
+            (rb             = OS_CALLOC(1, sizeof(struct broadcast_ringbuf))) &&
+            (rb->buffer     = OS_MALLOC(size)) &&
+            (rb->lock       = os_mutex_create()) &&
+            (rb->can_write  = os_cond_create())
+        );
+
+    if (!_success) {
+        brb_destroy(rb);
+        return NULL;
+    }
+
+    rb->size = size;
+    list_init(&rb->readers);
+    return rb;
+}
+
+static void brb_free_reader(brb_reader_handle reader)
+{
+    if (reader->can_read)
+        os_cond_destroy(reader->can_read);
+    OS_FREE(reader);
+}
+
+void brb_destroy(brb_handle rb)
+{
+    struct listnode *item, *tmp;
+    if (rb == NULL)
+        return;
+    if (rb->readers.next != NULL) {
+        list_for_each_safe(item, tmp, &rb->readers) {
+            brb_reader_handle reader = listnode_to_item(item, struct broadcast_ringbuf_reader, node);
+            list_remove(item);
+            brb_free_reader(reader);
+        }
+    }
+    if (rb->buffer)
+        OS_FREE(rb->buffer);
+    if (rb->can_write)
+        os_cond_destroy(rb->can_write);
+    if (rb->lock)
+        os_mutex_destroy(rb->lock);
+    OS_FREE(rb);
+}
+
+brb_reader_handle brb_add_reader(brb_handle rb, bool drop_if_slow)
+{
+    brb_reader_handle reader = OS_CALLOC(1, sizeof(struct broadcast_ringbuf_reader));
+    if (reader == NULL)
+        return NULL;
+    reader->can_read = os_cond_create();
+    if (reader->can_read == NULL) {
+        OS_FREE(reader);
+        return NULL;
+    }
+    reader->rb = rb;
+    reader->drop_if_slow = drop_if_slow;
+
+    os_mutex_lock(rb->lock);
+    reader->read_pos = rb->write_pos;
+    list_add_tail(&rb->readers, &reader->node);
+    os_mutex_unlock(rb->lock);
+    return reader;
+}
+
+void brb_remove_reader(brb_handle rb, brb_reader_handle reader)
+{
+    if (reader == NULL)
+        return;
+    os_mutex_lock(rb->lock);
+    list_remove(&reader->node);
+    // slowest reader may be gone
+    if (rb->write_waiters > 0)
+        os_cond_signal(rb->can_write);
+    os_mutex_unlock(rb->lock);
+    brb_free_reader(reader);
+}
+
+// brb_wait:
+//   Wait on @cond with lock held, @waiters is counted so that the other side
+//   can skip signalling when nobody is waiting
+static int brb_wait(brb_handle rb, os_cond cond, int *waiters,
+                    unsigned int timeout_ms, unsigned long long deadline)
+{
+    int ret;
+    (*waiters)++;
+    if (timeout_ms == 0)
+        ret = os_cond_wait(cond, rb->lock);
+    else
+        ret = os_cond_timedwait_until(cond, rb->lock, deadline);
+    (*waiters)--;
+    return ret;
+}
+
+// brb_reader_detached:
+//   Whether @reader is done or aborted, writer doesn't wait for it any more
+static inline bool brb_reader_detached(brb_reader_handle reader)
+{
+    return reader->is_done_read || reader->abort_read;
+}
+
+static int brb_available(brb_handle rb)
+{
+    unsigned long long min_pos = rb->write_pos;
+    struct listnode *item;
+    list_for_each(item, &rb->readers) {
+        brb_reader_handle reader = listnode_to_item(item, struct broadcast_ringbuf_reader, node);
+        if (!reader->drop_if_slow && !brb_reader_detached(reader) && reader->read_pos < min_pos)
+            min_pos = reader->read_pos;
+    }
+    return rb->size - (int)(rb->write_pos - min_pos);
+}
+
+static void brb_wake_readers(brb_handle rb, bool force)
+{
+    struct listnode *item;
+    list_for_each(item, &rb->readers) {
+        brb_reader_handle reader = listnode_to_item(item, struct broadcast_ringbuf_reader, node);
+        if (reader->read_waiters > 0 && (force || reader->is_reach_threshold))
+            os_cond_signal(reader->can_read);
+    }
+}
+
+// brb_advance_readers:
+//   Called after writing, move slow readers forward and update threshold
+static void brb_advance_readers(brb_handle rb)
+{
+    struct listnode *item;
+    list_for_each(item, &rb->readers) {
+        brb_reader_handle reader = listnode_to_item(item, struct broadcast_ringbuf_reader, node);
+        unsigned long long filled = rb->write_pos - reader->read_pos;
+        if (brb_reader_detached(reader))
+            continue;
+        if (filled > (unsigned long long)rb->size) {
+            reader->dropped += filled - rb->size;
+            reader->read_pos = rb->write_pos - rb->size;
+            filled = rb->size;
+        }
+        if (!reader->is_reach_threshold && filled >= (unsigned long long)reader->threshold_cnt)
+            reader->is_reach_threshold = true;
+    }
+}
+
+static void brb_copy_in(brb_handle rb, const char *buf, int len)
+{
+    int offset = (int)(rb->write_pos % rb->size);
+    int len1 = rb->size - offset;
+    if (len1 > len)
+        len1 = len;
+    memcpy(rb->buffer + offset, buf, len1);
+    memcpy(rb->buffer, buf + len1, len - len1);
+    rb->write_pos += len;
+}
+
+static void brb_copy_out(brb_reader_handle reader, char *buf, int len)
+{
+    brb_handle rb = reader->rb;
+    int offset = (int)(reader->read_pos % rb->size);
+    int len1 = rb->size - offset;
+    if (len1 > len)
+        len1 = len;
+    memcpy(buf, rb->buffer + offset, len1);
+    memcpy(buf + len1, rb->buffer, len - len1);
+    reader->read_pos += len;
+}
+
+int brb_write(brb_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
+{
+    int write_size = 0;
+    int total_write_size = 0;
+    int ret_val = 0;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+
+    if (buf == NULL || buf_len <= 0)
+        return RB_FAIL;
+
+    //take buffer lock
+    os_mutex_lock(rb->lock);
+
+    while (buf_len > 0) {
+        // aborted readers don't hold space, check abort before writing
+        if (rb->abort_write) {
+            ret_val = RB_ABORT;
+            goto write_err;
+        }
+
+        write_size = brb_available(rb);
+        if (buf_len < write_size)
+            write_size = buf_len;
+
+        if (write_size == 0) {
+            if (rb->is_done_write) {
+                ret_val = RB_DONE;
+                goto write_err;
+            }
+            brb_wake_readers(rb, true);
+            //wait till the slowest reader makes some room
+            ret_val = brb_wait(rb, rb->can_write, &rb->write_waiters, timeout_ms, deadline);
+            if (ret_val != 0) {
+                ret_val = RB_TIMEOUT;
+                goto write_err;
+            }
+            continue;
+        }
+
+        brb_copy_in(rb, buf, write_size);
+        brb_advance_readers(rb);
+
+        buf_len -= write_size;
+        total_write_size += write_size;
+        buf += write_size;
+    }
+
+write_err:
+    if (total_write_size > 0)
+        brb_wake_readers(rb, false);
+    os_mutex_unlock(rb->lock);
+    if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT))
+        total_write_size = ret_val;
+    return total_write_size > 0 ? total_write_size : ret_val;
+}
+
+int brb_read(brb_reader_handle reader, char *buf, int buf_len, unsigned int timeout_ms)
+{
+    brb_handle rb = reader->rb;
+    int read_size = 0;
+    int total_read_size = 0;
+    int ret_val = 0;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+
+    if (buf == NULL || buf_len <= 0)
+        return RB_FAIL;
+
+    //take buffer lock
+    os_mutex_lock(rb->lock);
+
+    while (buf_len > 0) {
+        // data of detached reader may have been overwritten already
+        if (reader->is_done_read) {
+            ret_val = RB_DONE;
+            goto read_err;
+        }
+        if (reader->abort_read) {
+            ret_val = RB_ABORT;
+            goto read_err;
+        }
+
+        read_size = (int)(rb->write_pos - reader->read_pos);
+        if (buf_len < read_size)
+            read_size = buf_len;
+
+        if (read_size == 0 || !reader->is_reach_threshold) {
+            if (rb->is_done_write) {
+                ret_val = RB_DONE;
+                goto read_err;
+            }
+            if (rb->write_waiters > 0)
+                os_cond_signal(rb->can_write);
+            //wait till some data available to read
+            ret_val = brb_wait(rb, reader->can_read, &reader->read_waiters, timeout_ms, deadline);
+            if (ret_val != 0) {
+                ret_val = RB_TIMEOUT;
+                goto read_err;
+            }
+            continue;
+        }
+
+        brb_copy_out(reader, buf, read_size);
+
+        buf_len -= read_size;
+        total_read_size += read_size;
+        buf += read_size;
+    }
+
+read_err:
+    if (total_read_size > 0 && rb->write_waiters > 0 && !reader->drop_if_slow)
+        os_cond_signal(rb->can_write);
+    os_mutex_unlock(rb->lock);
+    if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT))
+        total_read_size = ret_val;
+    return total_read_size > 0 ? total_read_size : ret_val;
+}
+
+void brb_done_write(brb_handle rb)
+{
+    struct listnode *item;
+    os_mutex_lock(rb->lock);
+    rb->is_done_write = true;
+    // let readers drain data below threshold
+    list_for_each(item, &rb->readers) {
+        brb_reader_handle reader = listnode_to_item(item, struct broadcast_ringbuf_reader, node);
+        reader->is_reach_threshold = true;
+    }
+    brb_wake_readers(rb, true);
+    os_mutex_unlock(rb->lock);
+}
+
+void brb_abort(brb_handle rb)
+{
+    struct listnode *item;
+    os_mutex_lock(rb->lock);
+    rb->abort_write = true;
+    list_for_each(item, &rb->readers) {
+        brb_reader_handle reader = listnode_to_item(item, struct broadcast_ringbuf_reader, node);
+        reader->abort_read = true;
+    }
+    brb_wake_readers(rb, true);
+    os_cond_signal(rb->can_write);
+    os_mutex_unlock(rb->lock);
+}
+
+void brb_reset(brb_handle rb)
+{
+    struct listnode *item;
+    os_mutex_lock(rb->lock);
+    rb->write_pos = 0;
+    rb->is_done_write = false;
+    rb->abort_write = false;
+    list_for_each(item, &rb->readers) {
+        brb_reader_handle reader = listnode_to_item(item, struct broadcast_ringbuf_reader, node);
+        reader->read_pos = 0;
+        reader->dropped = 0;
+        reader->abort_read = false;
+        reader->is_done_read = false;
+    }
+    os_cond_signal(rb->can_write);
+    os_mutex_unlock(rb->lock);
+}
+
+int brb_get_size(brb_handle rb)
+{
+    return rb->size;
+}
+
+int brb_bytes_available(brb_handle rb)
+{
+    int available;
+    os_mutex_lock(rb->lock);
+    available = brb_available(rb);
+    os_mutex_unlock(rb->lock);
+    return available;
+}
+
+int brb_reader_bytes_filled(brb_reader_handle reader)
+{
+    brb_handle rb = reader->rb;
+    int filled = 0;
+    os_mutex_lock(rb->lock);
+    // read_pos of detached reader isn't moved forward, it can be arbitrarily far behind
+    if (!brb_reader_detached(reader)) {
+        unsigned long long pending = rb->write_pos - reader->read_pos;
+        filled = pending < (unsigned long long)rb->size ? (int)pending : rb->size;
+    }
+    os_mutex_unlock(rb->lock);
+    return filled;
+}
+
+void brb_reader_set_threshold(brb_reader_handle reader, int threshold)
+{
+    brb_handle rb = reader->rb;
+    os_mutex_lock(rb->lock);
+    reader->threshold_cnt = threshold <= rb->size ? threshold : rb->size;
+    os_mutex_unlock(rb->lock);
+}
+
+void brb_reader_abort(brb_reader_handle reader)
+{
+    brb_handle rb = reader->rb;
+    os_mutex_lock(rb->lock);
+    reader->abort_read = true;
+    os_cond_signal(reader->can_read);
+    // writer may be waiting for this reader
+    if (rb->write_waiters > 0)
+        os_cond_signal(rb->can_write);
+    os_mutex_unlock(rb->lock);
+}
+
+void brb_reader_done(brb_reader_handle reader)
+{
+    brb_handle rb = reader->rb;
+    os_mutex_lock(rb->lock);
+    reader->is_done_read = true;
+    os_cond_signal(reader->can_read);
+    if (rb->write_waiters > 0)
+        os_cond_signal(rb->can_write);
+    os_mutex_unlock(rb->lock);
+}
+
+unsigned long long brb_reader_dropped(brb_reader_handle reader)
+{
+    unsigned long long dropped;
+    os_mutex_lock(reader->rb->lock);
+    dropped = reader->dropped;
+    os_mutex_unlock(reader->rb->lock);
+    return dropped;
+}
@@ -18,10 +18,18 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
+#include "osal/os_thread.h"
+#include "osal/os_time.h"
 #include "cutils/memory_helper.h"
 #include "cutils/log_helper.h"
 #include "cutils/lockfree_ringbuf.h"
 
+#define LOG_TAG "lockfree_ringbuf"
+
+// First park caps its wait by this, see lockfree_ringbuf_park()
+#define LOCKFREE_RINGBUF_ENABLE_WAKE_USEC 1000
+
 #if defined(__STDC_NO_ATOMICS__)
 // IMPORTANT:
 //   IF ATOMIC NOT SUPPORTED, DON'T USE THIS LOCKFREE-RINGBUF WHEN READ
@@ -30,42 +38,108 @@
 //   any risk.
 #warning __STDC_NO_ATOMICS__
 #define ATOMIC_DECLARE(obj)         int obj
+#define ATOMIC_INDEX_DECLARE(obj)   unsigned long obj
 #define ATOMIC_INIT(obj, val)       obj = val
 #define ATOMIC_LOAD(obj)            obj
+#define ATOMIC_LOAD_ACQUIRE(obj)    obj
+#define ATOMIC_LOAD_RELAXED(obj)    obj
 #define ATOMIC_STORE(obj, val)      obj = val
+#define ATOMIC_STORE_RELEASE(obj, val) obj = val
 #define ATOMIC_FETCH_ADD(obj, val)  obj += val
 #define ATOMIC_FETCH_SUB(obj, val)  obj -= val
+#define ATOMIC_FENCE()              do {} while (0)
 
 #else
 #include <stdatomic.h>
 #define ATOMIC_DECLARE(obj)         atomic_int obj
+#define ATOMIC_INDEX_DECLARE(obj)   atomic_ulong obj
 #define ATOMIC_INIT(obj, val)       atomic_init(&(obj), val)
 #define ATOMIC_LOAD(obj)            atomic_load(&(obj))
+#define ATOMIC_LOAD_ACQUIRE(obj)    atomic_load_explicit(&(obj), memory_order_acquire)
+#define ATOMIC_LOAD_RELAXED(obj)    atomic_load_explicit(&(obj), memory_order_relaxed)
 #define ATOMIC_STORE(obj, val)      atomic_store(&(obj), val)
+#define ATOMIC_STORE_RELEASE(obj, val) atomic_store_explicit(&(obj), val, memory_order_release)
 #define ATOMIC_FETCH_ADD(obj, val)  atomic_fetch_add(&(obj), val)
 #define ATOMIC_FETCH_SUB(obj, val)  atomic_fetch_sub(&(obj), val)
+#define ATOMIC_FENCE()              atomic_thread_fence(memory_order_seq_cst)
 #endif
 
+/*
+ * head and tail are free-running indices, they only increase and wrap around
+ * naturally, so (tail - head) is the filled size and (index & mask) is the
+ * offset in buffer. unsigned long is used as the widest type that is lock-free
+ * on both 32-bit and 64-bit targets, @buffer_size is limited to int anyway.
+ * Reader owns head and writer owns tail, each one keeps a cached copy of the
+ * other side's index and only reloads it when the cached value isn't enough,
+ * so the two sides don't touch each other's cache line on the fast path.
+ */
 struct lockfree_ringbuf {
-    char *p_o;                   /**< Original pointer */
-    char *volatile p_r;          /**< Read pointer */
-    char *volatile p_w;          /**< Write pointer */
-    ATOMIC_DECLARE(filled_size); /**< Number of filled slots */
-    int  buffer_size;            /**< Buffer buffer_size */
+    char *buffer;                /**< Buffer, size is power of 2 */
+    unsigned long mask;          /**< Buffer size - 1 */
+    int  buffer_size;            /**< Capacity in bytes, may be less than buffer size */
+    bool mirrored;               /**< Buffer is mapped twice back-to-back, never wraps around */
+    ATOMIC_DECLARE(blocking);    /**< Set once a blocking call parks, enables wakeups */
+
+    OS_CACHELINE_PAD(pad0, 0)
+    ATOMIC_INDEX_DECLARE(head);  /**< Read index, written by reader only */
+    unsigned long cached_tail;   /**< Reader's copy of tail */
+
+    OS_CACHELINE_PAD(pad1, 0)
+    ATOMIC_INDEX_DECLARE(tail);  /**< Write index, written by writer only */
+    unsigned long cached_head;   /**< Writer's copy of head */
+
+    OS_CACHELINE_PAD(pad2, 0)
+    // following are only for blocking read/write, lock is taken to park
+    // reader/writer when buffer is empty/full, never on the fast path
+    os_mutex lock;
+    os_cond can_read;
+    os_cond can_write;
+    os_mutex write_lock;           /**< Serialize writers of lockfree_ringbuf_write_wait() */
+    ATOMIC_DECLARE(read_waiters);  /**< Number of readers parking on can_read */
+    ATOMIC_DECLARE(write_waiters); /**< Number of writers parking on can_write */
+    ATOMIC_DECLARE(done_write);
+    ATOMIC_DECLARE(abort);
 };
 
-void *lockfree_ringbuf_create(int size)
+static void *lockfree_ringbuf_create_internal(int size, bool mirrored)
 {
+    unsigned long buffer_size = 1;
+    unsigned int granularity = mirrored ? os_mirror_granularity() : 0;
     if (size <= 0)
         return NULL;
-    struct lockfree_ringbuf *rb = OS_MALLOC(sizeof(struct lockfree_ringbuf));
+    while (buffer_size < (unsigned long)size || buffer_size < granularity)
+        buffer_size <<= 1;
+    struct lockfree_ringbuf *rb = OS_CALLOC(1, sizeof(struct lockfree_ringbuf));
     if (rb == NULL)
         return NULL;
+    if (granularity > 0 && buffer_size % granularity == 0) {
+        rb->buffer = os_mirror_alloc(buffer_size);
+        rb->mirrored = rb->buffer != NULL;
+    }
+    if (mirrored && !rb->mirrored) {
+        OS_LOGW(LOG_TAG, "Failed to map mirrored buffer, fallback to normal buffer");
+        buffer_size = 1;
+        while (buffer_size < (unsigned long)size)
+            buffer_size <<= 1;
+    }
     rb->buffer_size = size;
-    ATOMIC_INIT(rb->filled_size, 0);
-    rb->p_o = rb->p_r = rb->p_w = OS_MALLOC(size);
-    if (rb->p_o == NULL) {
-        OS_FREE(rb);
+    rb->mask = buffer_size - 1;
+    ATOMIC_INIT(rb->head, 0);
+    ATOMIC_INIT(rb->tail, 0);
+    ATOMIC_INIT(rb->blocking, 0);
+    ATOMIC_INIT(rb->read_waiters, 0);
+    ATOMIC_INIT(rb->write_waiters, 0);
+    ATOMIC_INIT(rb->done_write, 0);
+    ATOMIC_INIT(rb->abort, 0);
+    rb->lock = os_mutex_create();
+    rb->write_lock = os_mutex_create();
+    rb->can_read = os_cond_create();
+    rb->can_write = os_cond_create();
+    if (rb->buffer == NULL)
+        rb->buffer = OS_MALLOC(buffer_size);
+    if (rb->buffer == NULL || rb->lock == NULL || rb->write_lock == NULL ||
+        rb->can_read == NULL || rb->can_write == NULL) {
+        lockfree_ringbuf_destroy(rb);
         rb = NULL;
     }
     return rb;
@@ -76,11 +150,77 @@ void lockfree_ringbuf_destroy(void *handle)
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
     if (rb == NULL)
         return;
-    if (rb->p_o != NULL)
-        OS_FREE(rb->p_o);
+    if (rb->can_write != NULL)
+        os_cond_destroy(rb->can_write);
+    if (rb->can_read != NULL)
+        os_cond_destroy(rb->can_read);
+    if (rb->write_lock != NULL)
+        os_mutex_destroy(rb->write_lock);
+    if (rb->lock != NULL)
+        os_mutex_destroy(rb->lock);
+    if (rb->mirrored)
+        os_mirror_free(rb->buffer, rb->mask + 1);
+    else if (rb->buffer != NULL)
+        OS_FREE(rb->buffer);
     OS_FREE(rb);
 }
 
+void *lockfree_ringbuf_create(int size)
+{
+    return lockfree_ringbuf_create_internal(size, false);
+}
+
+void *lockfree_ringbuf_create_mirrored(int size)
+{
+    return lockfree_ringbuf_create_internal(size, true);
+}
+
+// lockfree_ringbuf_wake:
+//   Wake up reader (or writers) parking in blocking read (or write), skip the
+//   lock and syscall if nobody is waiting. The fence pairs with the fence in
+//   lockfree_ringbuf_park(), either we see the waiter or it sees our update.
+//   Nothing is parked until a blocking call has been made, so the non-blocking
+//   fast path doesn't pay for the fence before that
+static inline void lockfree_ringbuf_wake(struct lockfree_ringbuf *rb, bool reader)
+{
+    if (!ATOMIC_LOAD_RELAXED(rb->blocking))
+        return;
+    ATOMIC_FENCE();
+    if (reader ? ATOMIC_LOAD(rb->read_waiters) == 0 : ATOMIC_LOAD(rb->write_waiters) == 0)
+        return;
+    os_mutex_lock(rb->lock);
+    os_cond_broadcast(reader ? rb->can_read : rb->can_write);
+    os_mutex_unlock(rb->lock);
+}
+
+static int lockfree_ringbuf_filled(struct lockfree_ringbuf *rb)
+{
+    unsigned long head = ATOMIC_LOAD_ACQUIRE(rb->head);
+    unsigned long tail = ATOMIC_LOAD_ACQUIRE(rb->tail);
+    // snapshot of two indices, may be inconsistent if read by a third thread
+    return tail - head > (unsigned long)rb->buffer_size ? rb->buffer_size : (int)(tail - head);
+}
+
+static void lockfree_ringbuf_copy_in(struct lockfree_ringbuf *rb, unsigned long index, const char *buf, int len)
+{
+    unsigned long offset = index & rb->mask;
+    int len1 = rb->mask + 1 - offset;
+    if (rb->mirrored || len1 > len)
+        len1 = len;
+    memcpy(rb->buffer + offset, buf, len1);
+    memcpy(rb->buffer, buf + len1, len - len1);
+}
+
+static void lockfree_ringbuf_copy_out(struct lockfree_ringbuf *rb, unsigned long index, char *buf, int len)
+{
+    unsigned long offset = index & rb->mask;
+    int len1 = rb->mask + 1 - offset;
+    if (rb->mirrored || len1 > len)
+        len1 = len;
+    memcpy(buf, rb->buffer + offset, len1);
+    memcpy(buf + len1, rb->buffer, len - len1);
+}
+
 int lockfree_ringbuf_get_size(void *handle)
 {
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
@@ -94,7 +234,7 @@ int lockfree_ringbuf_bytes_available(void *handle)
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
     if (rb == NULL)
         return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
-    return (rb->buffer_size - ATOMIC_LOAD(rb->filled_size));
+    return rb->buffer_size - lockfree_ringbuf_filled(rb);
 }
 
 int lockfree_ringbuf_bytes_filled(void *handle)
@@ -102,7 +242,7 @@ int lockfree_ringbuf_bytes_filled(void *handle)
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
     if (rb == NULL)
         return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
-    return ATOMIC_LOAD(rb->filled_size);
+    return lockfree_ringbuf_filled(rb);
 }
 
 void lockfree_ringbuf_unsafe_reset(void *handle)
@@ -110,8 +250,22 @@ void lockfree_ringbuf_unsafe_reset(void *handle)
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
     if (rb == NULL)
         return;
-    rb->p_r = rb->p_w = rb->p_o;
-    ATOMIC_STORE(rb->filled_size, 0);
+    ATOMIC_STORE(rb->head, 0);
+    ATOMIC_STORE(rb->tail, 0);
+    rb->cached_head = rb->cached_tail = 0;
+    ATOMIC_STORE(rb->done_write, 0);
+    ATOMIC_STORE(rb->abort, 0);
+}
+
+// lockfree_ringbuf_readable:
+//   Reader side, return number of bytes that can be read, at most @len
+static int lockfree_ringbuf_readable(struct lockfree_ringbuf *rb, unsigned long head, int len)
+{
+    if (rb->cached_tail - head < (unsigned long)len)
+        rb->cached_tail = ATOMIC_LOAD_ACQUIRE(rb->tail);
+    if (rb->cached_tail - head < (unsigned long)len)
+        len = rb->cached_tail - head;
+    return len;
 }
 
 int lockfree_ringbuf_unsafe_discard(void *handle, int len)
@@ -119,17 +273,11 @@ int lockfree_ringbuf_unsafe_discard(void *handle, int len)
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
     if (rb == NULL || len <= 0)
         return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
-    int filled = ATOMIC_LOAD(rb->filled_size);
-    len = (len > filled) ? filled : len;
+    unsigned long head = ATOMIC_LOAD_RELAXED(rb->head);
+    len = lockfree_ringbuf_readable(rb, head, len);
     if (len > 0) {
-        if ((rb->p_r + len) > (rb->p_o + rb->buffer_size)) {
-            int rlen1 = rb->p_o + rb->buffer_size - rb->p_r;
-            int rlen2 = len - rlen1;
-            rb->p_r = rb->p_o + rlen2;
-        } else {
-            rb->p_r = rb->p_r + len;
-        }
-        ATOMIC_FETCH_SUB(rb->filled_size, len);
+        ATOMIC_STORE_RELEASE(rb->head, head + len);
+        lockfree_ringbuf_wake(rb, false);
     }
     return len;
 }
@@ -139,71 +287,312 @@ int lockfree_ringbuf_unsafe_overwrite(void *handle, char *buf, int len)
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
     if (rb == NULL || buf == NULL || len <= 0)
         return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
+    unsigned long tail = ATOMIC_LOAD_RELAXED(rb->tail);
     if (len <= rb->buffer_size) {
-        int available = rb->buffer_size - ATOMIC_LOAD(rb->filled_size);
+        int available = rb->buffer_size - (int)(tail - ATOMIC_LOAD_ACQUIRE(rb->head));
         if (len > available)
             lockfree_ringbuf_unsafe_discard(rb, len-available);
-        if ((rb->p_w + len) > (rb->p_o + rb->buffer_size)) {
-            int wlen1 = rb->p_o + rb->buffer_size - rb->p_w;
-            int wlen2 = len - wlen1;
-            memcpy(rb->p_w, buf, wlen1);
-            memcpy(rb->p_o, buf + wlen1, wlen2);
-            rb->p_w = rb->p_o + wlen2;
-        } else {
-            memcpy(rb->p_w, buf, len);
-            rb->p_w = rb->p_w + len;
-        }
-        ATOMIC_FETCH_ADD(rb->filled_size, len);
+        lockfree_ringbuf_copy_in(rb, tail, buf, len);
+        ATOMIC_STORE_RELEASE(rb->tail, tail + len);
     } else {
+        // keep the last buffer_size bytes only
         buf = buf + len - rb->buffer_size;
-        memcpy(rb->p_o, buf, rb->buffer_size);
-        rb->p_w = rb->p_o + rb->buffer_size;
-        rb->p_r = rb->p_o;
-        ATOMIC_STORE(rb->filled_size, rb->buffer_size);
+        ATOMIC_STORE_RELEASE(rb->head, tail);
+        lockfree_ringbuf_copy_in(rb, tail, buf, rb->buffer_size);
+        ATOMIC_STORE_RELEASE(rb->tail, tail + rb->buffer_size);
     }
+    lockfree_ringbuf_wake(rb, true);
     return len;
 }
 
-int lockfree_ringbuf_write(void *handle, char *buf, int len)
+// lockfree_ringbuf_iov_length:
+//   Return total length of @iov, -1 if invalid
+static int lockfree_ringbuf_iov_length(const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    int i;
+    if (iov == NULL || iovcnt <= 0)
+        return -1;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_base == NULL && iov[i].iov_len > 0)
+            return -1;
+        if (iov[i].iov_len > INT_MAX - total)
+            return -1;
+        total += iov[i].iov_len;
+    }
+    return (int)total;
+}
+
+int lockfree_ringbuf_writev(void *handle, const struct iovec *iov, int iovcnt)
 {
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
-    if (rb == NULL || buf == NULL || len <= 0)
+    int len = lockfree_ringbuf_iov_length(iov, iovcnt);
+    int i, offset = 0;
+    if (rb == NULL || len <= 0)
         return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
-    if (len > (rb->buffer_size-ATOMIC_LOAD(rb->filled_size)))
-        return LOCKFREE_RINGBUF_ERROR_INSUFFICIENT_WRITEABLE_BUFFER;
-    if ((rb->p_w + len) > (rb->p_o + rb->buffer_size)) {
-        int wlen1 = rb->p_o + rb->buffer_size - rb->p_w;
-        int wlen2 = len - wlen1;
-        memcpy(rb->p_w, buf, wlen1);
-        memcpy(rb->p_o, buf + wlen1, wlen2);
-        rb->p_w = rb->p_o + wlen2;
-    } else {
-        memcpy(rb->p_w, buf, len);
-        rb->p_w = rb->p_w + len;
+    unsigned long tail = ATOMIC_LOAD_RELAXED(rb->tail);
+    if (tail - rb->cached_head + len > (unsigned long)rb->buffer_size) {
+        rb->cached_head = ATOMIC_LOAD_ACQUIRE(rb->head);
+        if (tail - rb->cached_head + len > (unsigned long)rb->buffer_size)
+            return LOCKFREE_RINGBUF_ERROR_INSUFFICIENT_WRITEABLE_BUFFER;
     }
-    ATOMIC_FETCH_ADD(rb->filled_size, len);
+    for (i = 0; i < iovcnt; i++) {
+        lockfree_ringbuf_copy_in(rb, tail + offset, iov[i].iov_base, iov[i].iov_len);
+        offset += iov[i].iov_len;
+    }
+    // publish all buffers at once, reader never sees part of them
+    ATOMIC_STORE_RELEASE(rb->tail, tail + len);
+    lockfree_ringbuf_wake(rb, true);
     return len;
 }
 
-int lockfree_ringbuf_read(void *handle, char *buf, int len)
+int lockfree_ringbuf_readv(void *handle, const struct iovec *iov, int iovcnt)
 {
     struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
-    if (rb == NULL || buf == NULL || len <= 0)
+    int len = lockfree_ringbuf_iov_length(iov, iovcnt);
+    int i, n, offset = 0;
+    if (rb == NULL || len <= 0)
         return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
-    int filled = ATOMIC_LOAD(rb->filled_size);
-    len = (len > filled) ? filled : len;
+    unsigned long head = ATOMIC_LOAD_RELAXED(rb->head);
+    len = lockfree_ringbuf_readable(rb, head, len);
     if (len > 0) {
-        if ((rb->p_r + len) > (rb->p_o + rb->buffer_size)) {
-            int rlen1 = rb->p_o + rb->buffer_size - rb->p_r;
-            int rlen2 = len - rlen1;
-            memcpy(buf, rb->p_r, rlen1);
-            memcpy(buf + rlen1, rb->p_o, rlen2);
-            rb->p_r = rb->p_o + rlen2;
-        } else {
-            memcpy(buf, rb->p_r, len);
-            rb->p_r = rb->p_r + len;
+        for (i = 0; i < iovcnt && offset < len; i++) {
+            n = iov[i].iov_len < (size_t)(len - offset) ? (int)iov[i].iov_len : len - offset;
+            lockfree_ringbuf_copy_out(rb, head + offset, iov[i].iov_base, n);
+            offset += n;
         }
-        ATOMIC_FETCH_SUB(rb->filled_size, len);
+        ATOMIC_STORE_RELEASE(rb->head, head + len);
+        lockfree_ringbuf_wake(rb, false);
     }
     return len;
 }
+
+int lockfree_ringbuf_write(void *handle, char *buf, int len)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len > 0 ? len : 0 };
+    if (buf == NULL || len <= 0)
+        return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
+    return lockfree_ringbuf_writev(handle, &iov, 1);
+}
+
+int lockfree_ringbuf_read(void *handle, char *buf, int len)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len > 0 ? len : 0 };
+    if (buf == NULL || len <= 0)
+        return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
+    return lockfree_ringbuf_readv(handle, &iov, 1);
+}
+
+#if !defined(OS_RTOS)
+// lockfree_ringbuf_region:
+//   Split @len bytes starting from @index into at most two iovec, return
+//   number of iovec
+static int lockfree_ringbuf_region(struct lockfree_ringbuf *rb, unsigned long index, int len, struct iovec iov[2])
+{
+    unsigned long offset = index & rb->mask;
+    int len1 = rb->mask + 1 - offset;
+    if (rb->mirrored || len1 > len)
+        len1 = len;
+    iov[0].iov_base = rb->buffer + offset;
+    iov[0].iov_len = len1;
+    iov[1].iov_base = rb->buffer;
+    iov[1].iov_len = len - len1;
+    return len > len1 ? 2 : 1;
+}
+
+int lockfree_ringbuf_write_from_fd(void *handle, int fd, int len)
+{
+    struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
+    struct iovec iov[2];
+    ssize_t ret;
+    if (rb == NULL || fd < 0 || len <= 0)
+        return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
+    unsigned long tail = ATOMIC_LOAD_RELAXED(rb->tail);
+    rb->cached_head = ATOMIC_LOAD_ACQUIRE(rb->head);
+    int available = rb->buffer_size - (int)(tail - rb->cached_head);
+    if (available == 0)
+        return LOCKFREE_RINGBUF_ERROR_INSUFFICIENT_WRITEABLE_BUFFER;
+    if (len > available)
+        len = available;
+    ret = readv(fd, iov, lockfree_ringbuf_region(rb, tail, len, iov));
+    if (ret < 0)
+        return LOCKFREE_RINGBUF_ERROR_IO;
+    if (ret > 0) {
+        ATOMIC_STORE_RELEASE(rb->tail, tail + ret);
+        lockfree_ringbuf_wake(rb, true);
+    }
+    return (int)ret;
+}
+
+int lockfree_ringbuf_read_to_fd(void *handle, int fd, int len)
+{
+    struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
+    struct iovec iov[2];
+    ssize_t ret;
+    if (rb == NULL || fd < 0 || len <= 0)
+        return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
+    unsigned long head = ATOMIC_LOAD_RELAXED(rb->head);
+    len = lockfree_ringbuf_readable(rb, head, len);
+    if (len == 0)
+        return 0;
+    ret = writev(fd, iov, lockfree_ringbuf_region(rb, head, len, iov));
+    if (ret < 0)
+        return LOCKFREE_RINGBUF_ERROR_IO;
+    if (ret > 0) {
+        ATOMIC_STORE_RELEASE(rb->head, head + ret);
+        lockfree_ringbuf_wake(rb, false);
+    }
+    return (int)ret;
+}
+#endif
+
+// lockfree_ringbuf_park:
+//   Slow path, park until there is data to read (or space to write), done,
+//   abort or deadline. Return 0 if woken up, LOCKFREE_RINGBUF_TIMEOUT if
+//   deadline is reached.
+//   The first park enables wakeups, a peer that updated the index before it
+//   saw the flag may skip the wakeup, so that park re-checks after a short
+//   wait instead of sleeping until deadline
+static int lockfree_ringbuf_park(struct lockfree_ringbuf *rb, bool reader,
+                                 unsigned int timeout_ms, unsigned long long deadline)
+{
+    bool enabling = !ATOMIC_LOAD_RELAXED(rb->blocking);
+    unsigned long long until = deadline;
+    int ret = 0;
+
+    if (enabling) {
+        ATOMIC_STORE(rb->blocking, 1);
+        until = os_monotonic_usec() + LOCKFREE_RINGBUF_ENABLE_WAKE_USEC;
+        if (timeout_ms != 0 && deadline < until)
+            until = deadline;
+    }
+
+    os_mutex_lock(rb->lock);
+    if (reader)
+        ATOMIC_FETCH_ADD(rb->read_waiters, 1);
+    else
+        ATOMIC_FETCH_ADD(rb->write_waiters, 1);
+    ATOMIC_FENCE();
+
+    while ((reader ? lockfree_ringbuf_filled(rb) == 0 :
+                     lockfree_ringbuf_filled(rb) == rb->buffer_size) &&
+           !ATOMIC_LOAD(rb->done_write) && !ATOMIC_LOAD(rb->abort)) {
+        if (timeout_ms == 0 && !enabling) {
+            os_cond_wait(reader ? rb->can_read : rb->can_write, rb->lock);
+        } else if (os_cond_timedwait_until(reader ? rb->can_read : rb->can_write,
+                                           rb->lock, until) != 0) {
+            if (enabling && (timeout_ms == 0 || until < deadline)) {
+                enabling = false;
+                until = deadline;
+                continue;
+            }
+            ret = LOCKFREE_RINGBUF_TIMEOUT;
+            break;
+        }
+    }
+
+    if (reader)
+        ATOMIC_FETCH_SUB(rb->read_waiters, 1);
+    else
+        ATOMIC_FETCH_SUB(rb->write_waiters, 1);
+    os_mutex_unlock(rb->lock);
+    return ret;
+}
+
+int lockfree_ringbuf_read_wait(void *handle, char *buf, int len, unsigned int timeout_ms)
+{
+    struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+    int total = 0, ret = 0, n;
+
+    if (rb == NULL || buf == NULL || len <= 0)
+        return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
+
+    while (total < len) {
+        if (ATOMIC_LOAD(rb->abort)) {
+            ret = LOCKFREE_RINGBUF_ABORT;
+            break;
+        }
+        n = lockfree_ringbuf_read(rb, buf + total, len - total);
+        if (n > 0) {
+            total += n;
+            continue;
+        }
+        if (ATOMIC_LOAD(rb->done_write)) {
+            ret = LOCKFREE_RINGBUF_DONE;
+            break;
+        }
+        ret = lockfree_ringbuf_park(rb, true, timeout_ms, deadline);
+        if (ret != 0 && lockfree_ringbuf_filled(rb) == 0)
+            break;
+        ret = 0;
+    }
+
+    if (ret == LOCKFREE_RINGBUF_ABORT)
+        return ret;
+    return total > 0 ? total : ret;
+}
+
+int lockfree_ringbuf_write_wait(void *handle, char *buf, int len, unsigned int timeout_ms)
+{
+    struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+    int total = 0, ret = 0, n;
+
+    if (rb == NULL || buf == NULL || len <= 0)
+        return LOCKFREE_RINGBUF_ERROR_INVALID_PARAMETER;
+
+    os_mutex_lock(rb->write_lock);
+
+    while (total < len) {
+        if (ATOMIC_LOAD(rb->abort)) {
+            ret = LOCKFREE_RINGBUF_ABORT;
+            break;
+        }
+        if (ATOMIC_LOAD(rb->done_write)) {
+            ret = LOCKFREE_RINGBUF_DONE;
+            break;
+        }
+        n = rb->buffer_size - lockfree_ringbuf_filled(rb);
+        if (n > len - total)
+            n = len - total;
+        if (n > 0) {
+            total += lockfree_ringbuf_write(rb, buf + total, n);
+            continue;
+        }
+        ret = lockfree_ringbuf_park(rb, false, timeout_ms, deadline);
+        if (ret != 0 && lockfree_ringbuf_filled(rb) == rb->buffer_size)
+            break;
+        ret = 0;
+    }
+
+    os_mutex_unlock(rb->write_lock);
+
+    if (ret == LOCKFREE_RINGBUF_ABORT)
+        return ret;
+    return total > 0 ? total : ret;
+}
+
+void lockfree_ringbuf_done_write(void *handle)
+{
+    struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
+    if (rb == NULL)
+        return;
+    ATOMIC_STORE(rb->done_write, 1);
+    os_mutex_lock(rb->lock);
+    os_cond_broadcast(rb->can_read);
+    os_cond_broadcast(rb->can_write);
+    os_mutex_unlock(rb->lock);
+}
+
+void lockfree_ringbuf_abort(void *handle)
+{
+    struct lockfree_ringbuf *rb = (struct lockfree_ringbuf *)handle;
+    if (rb == NULL)
+        return;
+    ATOMIC_STORE(rb->abort, 1);
+    os_mutex_lock(rb->lock);
+    os_cond_broadcast(rb->can_read);
+    os_cond_broadcast(rb->can_write);
+    os_mutex_unlock(rb->lock);
+}
@@ -22,16 +22,100 @@
 #include "cutils/list.h"
 #include "cutils/mlooper.h"
 
+#if !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define MLOOPER_HAVE_ATOMIC 1
+#endif
+
 #define LOG_TAG "mlooper"
 
+#define MLOOPER_HEAP_INIT_CAPACITY     16
+#define MLOOPER_HEAP_INVALID_INDEX     ((unsigned int)-1)
+
+#define MLOOPER_NODE_POOL_CLASS_COUNT  5
+
+// Size classes of node->reserve for pooled nodes, a buffer larger than
+// the last class isn't pooled
+static const unsigned int mlooper_node_pool_class_size[MLOOPER_NODE_POOL_CLASS_COUNT] = {
+    0, 32, 64, 128, 256,
+};
+
+struct mlooper_node_pool {
+    os_mutex lock;
+    struct listnode free_list[MLOOPER_NODE_POOL_CLASS_COUNT];
+    unsigned int cached;     // number of nodes in free_list
+    unsigned int capacity;   // max number of cached nodes, 0: pool disabled
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+struct mlooper_idle {
+    struct listnode listnode;
+    bool (*on_idle)(void *arg);
+    void *arg;
+    bool removed; // removed while running
+};
+
+struct mlooper_heap {
+    struct message_node **nodes;
+    unsigned int size;
+    unsigned int capacity;
+    bool by_timeout; // ordered by timeout, otherwise by (when, seq)
+};
+
 struct mlooper {
+    // Messages due at posting time are queued to @msg_list in FIFO order,
+    // delayed messages are kept in @msg_heap, a binary min-heap ordered by
+    // (when, seq), so that posting and peeking don't need to walk the queue
     struct listnode msg_list;
+    struct mlooper_heap msg_heap;
+    // Pending messages that have timeout, ordered by timeout, so that looper
+    // can expire them without waiting for them to reach the queue head
+    struct mlooper_heap timeout_heap;
+    unsigned long long msg_seq;
     unsigned int msg_count;
+    // Optional hashed index by message what, each bucket links pending nodes
+    // through node->hashnode, so that removing by what needn't walk the queue
+    struct listnode *msg_index;
+    unsigned int msg_index_mask;
+    unsigned int batch_size; // max messages taken from queue per lock acquisition
     message_cb msg_handle;
     message_cb msg_free;
     os_mutex msg_mutex;
     os_cond msg_cond;
 
+    struct mlooper_node_pool node_pool;
+
+    // MLOOPER_FLAG_STATS: protected by @stats_mutex, which nests inside msg_mutex
+    struct mlooper_stats *stats;
+    os_mutex stats_mutex;
+
+    // Idle handlers run on looper thread once no message is due, and again only
+    // after some message is dispatched. Handlers being run are moved to
+    // @idle_running, so they can be added/removed from callback
+    struct listnode idle_list;
+    struct listnode idle_running;
+    struct mlooper_idle *idle_current;
+    bool idle_pending;
+
+    // Worker of mlooper_pool: plain messages are queued to @steal_list, that
+    // other idle workers of the pool can steal from its tail. @idle is set
+    // while parking and cleared by posters that wake it up, both with pool
+    // lock held, see mlooper_pool_park()
+    struct mlooper_pool *pool;
+    struct listnode steal_list;
+    bool idle;
+
+    // MLOOPER_FLAG_LOCKFREE_POST: immediate messages are pushed to @inbox, a
+    // lock-free LIFO linked through listnode.next, and moved to msg_list by
+    // whoever holds msg_mutex. Posters signal msg_cond only if @sleeping is set
+    bool lockfree_post;
+#if defined(MLOOPER_HAVE_ATOMIC)
+    _Atomic(struct listnode *) inbox;
+    atomic_uint inbox_count;
+    atomic_bool sleeping;
+#endif
+
     os_thread thread_id;
     const char *thread_name;
     struct os_thread_attr thread_attr;
@@ -46,7 +130,14 @@ struct message_node {
     struct message msg;
     unsigned long long when;
     unsigned long long timeout;
+    unsigned long long seq;  // posting sequence, keeps FIFO order for the same @when
+    unsigned int heap_index;    // MLOOPER_HEAP_INVALID_INDEX if node isn't in msg_heap
+    unsigned int timeout_index; // MLOOPER_HEAP_INVALID_INDEX if node isn't in timeout_heap
+    struct mlooper_node_pool *node_pool; // pool the node returns to, NULL if allocated by message_obtain()
+    unsigned int pool_class;
     os_thread owner_thread;
+    struct mlooper_waiter *waiter; // sender blocked in mlooper_send_message_sync(), NULL if posted
+    struct listnode hashnode; // linked to looper->msg_index if enabled while pending
     struct listnode listnode;
     // @reserve must be the last member of message_node, as user of this structure
     // will cast a buffer to node->reserve pointer in contexts where it's known
@@ -55,9 +146,271 @@ struct message_node {
     char reserve[0];
 };
 
+// Thread that sends a message synchronously sleeps on its own waiter, which
+// is created on first use, kept in thread-specific storage and reused by
+// later calls of the thread
+struct mlooper_waiter {
+    os_mutex mutex; // NULL if message is handled inline by looper thread
+    os_cond cond;
+    bool done;
+    bool handled;
+    int result;
+};
+
+#if defined(MLOOPER_HAVE_ATOMIC)
+static _Atomic(os_thread_key) mlooper_waiter_key;
+#endif
+
+static inline unsigned int mlooper_node_pool_size(unsigned int class_size)
+{
+    unsigned int total = sizeof(struct message_node);
+    if (class_size > 0)
+        total += (class_size + sizeof(long long));
+    return total;
+}
+
+static struct message_node *mlooper_node_pool_get(struct mlooper_node_pool *pool, unsigned int size)
+{
+    struct message_node *node = NULL;
+    unsigned int class;
+
+    for (class = 0; class < MLOOPER_NODE_POOL_CLASS_COUNT; class++) {
+        if (size <= mlooper_node_pool_class_size[class])
+            break;
+    }
+
+    os_mutex_lock(pool->lock);
+    if (class < MLOOPER_NODE_POOL_CLASS_COUNT && !list_empty(&pool->free_list[class])) {
+        struct listnode *item = list_head(&pool->free_list[class]);
+        list_remove(item);
+        pool->cached--;
+        pool->hits++;
+        node = listnode_to_item(item, struct message_node, listnode);
+    } else {
+        pool->misses++;
+    }
+    os_mutex_unlock(pool->lock);
+
+    if (class == MLOOPER_NODE_POOL_CLASS_COUNT) {
+        // too large to pool, allocate as message_obtain_buffer_obtain() does
+        node = OS_CALLOC(1, mlooper_node_pool_size(size));
+        return node;
+    }
+
+    if (node != NULL)
+        memset(node, 0x0, mlooper_node_pool_size(mlooper_node_pool_class_size[class]));
+    else
+        node = OS_CALLOC(1, mlooper_node_pool_size(mlooper_node_pool_class_size[class]));
+    if (node != NULL) {
+        node->node_pool = pool;
+        node->pool_class = class;
+    }
+    return node;
+}
+
+static void mlooper_node_pool_put(struct message_node *node)
+{
+    struct mlooper_node_pool *pool = node->node_pool;
+
+    if (pool != NULL) {
+        os_mutex_lock(pool->lock);
+        if (pool->cached < pool->capacity) {
+            list_add_head(&pool->free_list[node->pool_class], &node->listnode);
+            pool->cached++;
+            node = NULL;
+        }
+        os_mutex_unlock(pool->lock);
+    }
+    if (node != NULL)
+        OS_FREE(node);
+}
+
+static void mlooper_node_pool_deinit(struct mlooper_node_pool *pool)
+{
+    struct message_node *node;
+    struct listnode *item, *tmp;
+    unsigned int class;
+
+    if (pool->lock == NULL)
+        return;
+    for (class = 0; class < MLOOPER_NODE_POOL_CLASS_COUNT; class++) {
+        list_for_each_safe(item, tmp, &pool->free_list[class]) {
+            node = listnode_to_item(item, struct message_node, listnode);
+            list_remove(item);
+            OS_FREE(node);
+        }
+    }
+    pool->cached = 0;
+    os_mutex_destroy(pool->lock);
+    pool->lock = NULL;
+}
+
+static void mlooper_histogram_add(struct mlooper_histogram *hist, unsigned long long usec)
+{
+    unsigned int bucket = 0;
+    if (usec >= (1ULL << (MLOOPER_STATS_BUCKET_COUNT - 1)))
+        bucket = MLOOPER_STATS_BUCKET_COUNT - 1;
+    else if (usec > 0)
+        bucket = 31 - __builtin_clz((unsigned int)usec);
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum_usec += usec;
+    if (usec > hist->max_usec)
+        hist->max_usec = usec;
+}
+
+// mlooper_stats_of:
+//   Return per-what stats entry, NULL if table is full. Caller must hold stats_mutex
+static struct mlooper_message_stats *mlooper_stats_of(mlooper_handle looper, int what)
+{
+    struct mlooper_stats *stats = looper->stats;
+    unsigned int i;
+    for (i = 0; i < stats->what_count; i++) {
+        if (stats->per_what[i].what == what)
+            return &stats->per_what[i];
+    }
+    if (stats->what_count < MLOOPER_STATS_WHAT_COUNT) {
+        stats->per_what[stats->what_count].what = what;
+        return &stats->per_what[stats->what_count++];
+    }
+    return NULL;
+}
+
+// mlooper_stats_depth:
+//   Sample queue depth after a post. Caller must hold msg_mutex
+static void mlooper_stats_depth(mlooper_handle looper)
+{
+    unsigned int depth;
+    if (looper->stats == NULL)
+        return;
+    depth = looper->msg_count;
+#if defined(MLOOPER_HAVE_ATOMIC)
+    if (looper->lockfree_post)
+        depth += atomic_load(&looper->inbox_count);
+#endif
+    os_mutex_lock(looper->stats_mutex);
+    looper->stats->depth_samples++;
+    looper->stats->depth_sum += depth;
+    if (depth > looper->stats->max_depth)
+        looper->stats->max_depth = depth;
+    os_mutex_unlock(looper->stats_mutex);
+}
+
+// mlooper_stats_finish:
+//   Account a message that leaves the looper, handled or not
+static void mlooper_stats_finish(mlooper_handle looper, struct message_node *node,
+                                 unsigned long long start, unsigned long long end)
+{
+    struct mlooper_message_stats *entry[2];
+    unsigned int i;
+
+    os_mutex_lock(looper->stats_mutex);
+    entry[0] = &looper->stats->total;
+    entry[1] = mlooper_stats_of(looper, node->msg.what);
+    for (i = 0; i < 2 && entry[i] != NULL; i++) {
+        switch (node->msg.state) {
+        case MESSAGE_STATE_HANDLED:
+            mlooper_histogram_add(&entry[i]->latency, start > node->when ? start - node->when : 0);
+            mlooper_histogram_add(&entry[i]->handling, end - start);
+            break;
+        case MESSAGE_STATE_TIMEOUT:
+            entry[i]->timeout_count++;
+            break;
+        default:
+            entry[i]->discard_count++;
+            break;
+        }
+    }
+    os_mutex_unlock(looper->stats_mutex);
+}
+
+static void mlooper_waiter_destroy(void *arg)
+{
+    struct mlooper_waiter *waiter = (struct mlooper_waiter *)arg;
+    if (waiter->cond != NULL)
+        os_cond_destroy(waiter->cond);
+    if (waiter->mutex != NULL)
+        os_mutex_destroy(waiter->mutex);
+    OS_FREE(waiter);
+}
+
+static struct mlooper_waiter *mlooper_waiter_create()
+{
+    struct mlooper_waiter *waiter = OS_CALLOC(1, sizeof(struct mlooper_waiter));
+    if (waiter == NULL)
+        return NULL;
+    waiter->mutex = os_mutex_create();
+    waiter->cond = os_cond_create();
+    if (waiter->mutex == NULL || waiter->cond == NULL) {
+        mlooper_waiter_destroy(waiter);
+        return NULL;
+    }
+    return waiter;
+}
+
+// mlooper_waiter_acquire:
+//   Return waiter of the calling thread. If thread-specific storage isn't
+//   available, a temporary waiter is created and mlooper_waiter_release()
+//   will destroy it
+static struct mlooper_waiter *mlooper_waiter_acquire(bool *cached)
+{
+    struct mlooper_waiter *waiter;
+#if defined(MLOOPER_HAVE_ATOMIC)
+    os_thread_key key = atomic_load(&mlooper_waiter_key);
+    if (key == NULL) {
+        os_thread_key expected = NULL;
+        key = os_thread_key_create(mlooper_waiter_destroy);
+        if (key != NULL && !atomic_compare_exchange_strong(&mlooper_waiter_key, &expected, key)) {
+            os_thread_key_delete(key);
+            key = expected;
+        }
+    }
+    if (key != NULL) {
+        waiter = os_thread_key_get(key);
+        if (waiter == NULL) {
+            waiter = mlooper_waiter_create();
+            if (waiter != NULL && os_thread_key_set(key, waiter) != 0) {
+                mlooper_waiter_destroy(waiter);
+                waiter = NULL;
+            }
+        }
+        if (waiter != NULL) {
+            *cached = true;
+            return waiter;
+        }
+    }
+#endif
+    *cached = false;
+    return mlooper_waiter_create();
+}
+
+static void mlooper_waiter_release(struct mlooper_waiter *waiter, bool cached)
+{
+    if (!cached)
+        mlooper_waiter_destroy(waiter);
+}
+
+static void mlooper_waiter_wake(struct mlooper_waiter *waiter, bool handled)
+{
+    if (waiter->mutex == NULL) {
+        waiter->handled = handled;
+        waiter->done = true;
+        return;
+    }
+    os_mutex_lock(waiter->mutex);
+    waiter->handled = handled;
+    waiter->done = true;
+    os_cond_signal(waiter->cond);
+    os_mutex_unlock(waiter->mutex);
+}
+
 static void mlooper_free_msgnode(mlooper_handle looper, struct message_node *node)
 {
     struct message *msg = &node->msg;
+    struct mlooper_waiter *waiter = node->waiter;
+    bool handled = msg->state == MESSAGE_STATE_HANDLED;
+    if (looper->stats != NULL && msg->state != MESSAGE_STATE_HANDLED)
+        mlooper_stats_finish(looper, node, 0, 0);
     if (msg->state != MESSAGE_STATE_HANDLED) {
         //OS_LOGW(LOG_TAG, "[%s]: Discarded message: what=[%d], state=[%d]",
         //        looper->thread_name, msg->what, msg->state);
@@ -68,7 +421,326 @@ static void mlooper_free_msgnode(mlooper_handle looper, struct message_node *nod
         msg->on_free(msg);
     else if (looper->msg_free != NULL)
         looper->msg_free(msg);
-    OS_FREE(node);
+    mlooper_node_pool_put(node);
+    // wake sender after message is freed, it may destroy the looper at once
+    if (waiter != NULL)
+        mlooper_waiter_wake(waiter, handled);
+}
+
+static inline struct listnode *mlooper_index_bucket(mlooper_handle looper, int what)
+{
+    unsigned int hash = (unsigned int)what * 0x9E3779B1U;
+    return &looper->msg_index[(hash ^ (hash >> 16)) & looper->msg_index_mask];
+}
+
+static inline void mlooper_index_add(mlooper_handle looper, struct message_node *node)
+{
+    if (looper->msg_index != NULL)
+        list_add_tail(mlooper_index_bucket(looper, node->msg.what), &node->hashnode);
+}
+
+static inline void mlooper_index_del(mlooper_handle looper, struct message_node *node)
+{
+    if (looper->msg_index != NULL)
+        list_remove(&node->hashnode);
+}
+
+static inline bool mlooper_msgnode_before(struct message_node *a, struct message_node *b)
+{
+    return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static inline bool mlooper_heap_before(struct mlooper_heap *heap,
+                                       struct message_node *a, struct message_node *b)
+{
+    if (heap->by_timeout)
+        return a->timeout < b->timeout;
+    return mlooper_msgnode_before(a, b);
+}
+
+static inline unsigned int *mlooper_heap_index(struct mlooper_heap *heap, struct message_node *node)
+{
+    return heap->by_timeout ? &node->timeout_index : &node->heap_index;
+}
+
+static inline void mlooper_heap_set(struct mlooper_heap *heap, unsigned int index, struct message_node *node)
+{
+    heap->nodes[index] = node;
+    *mlooper_heap_index(heap, node) = index;
+}
+
+static void mlooper_heap_sift_up(struct mlooper_heap *heap, unsigned int index)
+{
+    struct message_node *node = heap->nodes[index];
+    while (index > 0) {
+        unsigned int parent = (index - 1) / 2;
+        if (!mlooper_heap_before(heap, node, heap->nodes[parent]))
+            break;
+        mlooper_heap_set(heap, index, heap->nodes[parent]);
+        index = parent;
+    }
+    mlooper_heap_set(heap, index, node);
+}
+
+static void mlooper_heap_sift_down(struct mlooper_heap *heap, unsigned int index)
+{
+    struct message_node *node = heap->nodes[index];
+    unsigned int size = heap->size;
+    while (1) {
+        unsigned int child = index * 2 + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size &&
+            mlooper_heap_before(heap, heap->nodes[child + 1], heap->nodes[child]))
+            child++;
+        if (!mlooper_heap_before(heap, heap->nodes[child], node))
+            break;
+        mlooper_heap_set(heap, index, heap->nodes[child]);
+        index = child;
+    }
+    mlooper_heap_set(heap, index, node);
+}
+
+static int mlooper_heap_push(struct mlooper_heap *heap, struct message_node *node)
+{
+    if (heap->size >= heap->capacity) {
+        unsigned int capacity = heap->capacity > 0 ? heap->capacity * 2 : MLOOPER_HEAP_INIT_CAPACITY;
+        struct message_node **nodes = OS_REALLOC(heap->nodes, capacity * sizeof(struct message_node *));
+        if (nodes == NULL)
+            return -1;
+        heap->nodes = nodes;
+        heap->capacity = capacity;
+    }
+    heap->nodes[heap->size] = node;
+    heap->size++;
+    mlooper_heap_sift_up(heap, heap->size - 1);
+    return 0;
+}
+
+static void mlooper_heap_remove(struct mlooper_heap *heap, struct message_node *node)
+{
+    unsigned int index = *mlooper_heap_index(heap, node);
+    struct message_node *last;
+
+    heap->size--;
+    if (index != heap->size) {
+        last = heap->nodes[heap->size];
+        mlooper_heap_set(heap, index, last);
+        if (index > 0 && mlooper_heap_before(heap, last, heap->nodes[(index - 1) / 2]))
+            mlooper_heap_sift_up(heap, index);
+        else
+            mlooper_heap_sift_down(heap, index);
+    }
+    *mlooper_heap_index(heap, node) = MLOOPER_HEAP_INVALID_INDEX;
+}
+
+// mlooper_track_msgnode/mlooper_untrack_msgnode:
+//   Add the message to or drop it from what index and timeout_heap, called
+//   whenever a message enters or leaves the queue. Caller must hold msg_mutex
+static void mlooper_track_msgnode(mlooper_handle looper, struct message_node *node)
+{
+    mlooper_index_add(looper, node);
+    node->timeout_index = MLOOPER_HEAP_INVALID_INDEX;
+    // if heap can't grow, the message just times out when it reaches queue head
+    if (node->timeout > 0 && mlooper_heap_push(&looper->timeout_heap, node) != 0)
+        OS_LOGW(LOG_TAG, "[%s]: Failed to grow timeout heap", looper->thread_name);
+}
+
+static void mlooper_untrack_msgnode(mlooper_handle looper, struct message_node *node)
+{
+    mlooper_index_del(looper, node);
+    if (node->timeout_index != MLOOPER_HEAP_INVALID_INDEX)
+        mlooper_heap_remove(&looper->timeout_heap, node);
+}
+
+// mlooper_drain_inbox:
+//   Move messages of lock-free inbox to msg_list in posting order.
+//   Caller must hold msg_mutex, which makes the caller the single consumer
+static void mlooper_drain_inbox(mlooper_handle looper)
+{
+#if defined(MLOOPER_HAVE_ATOMIC)
+    struct listnode *item, *next, *fifo = NULL;
+    struct message_node *node, *tail;
+    unsigned int count = 0;
+
+    if (!looper->lockfree_post || atomic_load_explicit(&looper->inbox, memory_order_relaxed) == NULL)
+        return;
+
+    // inbox is LIFO, reverse it to get posting order
+    item = atomic_exchange_explicit(&looper->inbox, NULL, memory_order_acquire);
+    while (item != NULL) {
+        next = item->next;
+        item->next = fifo;
+        fifo = item;
+        item = next;
+    }
+
+    for (item = fifo; item != NULL; item = next) {
+        next = item->next;
+        node = listnode_to_item(item, struct message_node, listnode);
+        node->seq = ++looper->msg_seq;
+        if (!list_empty(&looper->msg_list)) {
+            tail = listnode_to_item(list_tail(&looper->msg_list), struct message_node, listnode);
+            if (node->when < tail->when)
+                node->when = tail->when;
+        }
+        list_add_tail(&looper->msg_list, item);
+        mlooper_track_msgnode(looper, node);
+        count++;
+    }
+    looper->msg_count += count;
+    atomic_fetch_sub(&looper->inbox_count, count);
+    mlooper_stats_depth(looper);
+#endif
+}
+
+// mlooper_wait_message:
+//   Park looper thread until @deadline (os_monotonic_usec() based), wait
+//   forever if @deadline is zero.
+//   Caller must hold msg_mutex. In lock-free posting mode, @sleeping is
+//   published before the inbox is re-checked, and posters check @sleeping
+//   after pushing, so either side sees the other and no wakeup is lost
+static void mlooper_wait_message(mlooper_handle looper, unsigned long long deadline)
+{
+#if defined(MLOOPER_HAVE_ATOMIC)
+    if (looper->lockfree_post) {
+        atomic_store(&looper->sleeping, true);
+        if (atomic_load(&looper->inbox) != NULL) {
+            atomic_store(&looper->sleeping, false);
+            mlooper_drain_inbox(looper);
+            return;
+        }
+    }
+#endif
+
+    if (deadline == 0)
+        os_cond_wait(looper->msg_cond, looper->msg_mutex);
+    else
+        os_cond_timedwait_until(looper->msg_cond, looper->msg_mutex, deadline);
+
+#if defined(MLOOPER_HAVE_ATOMIC)
+    if (looper->lockfree_post) {
+        atomic_store(&looper->sleeping, false);
+        mlooper_drain_inbox(looper);
+    }
+#endif
+}
+
+// mlooper_peek_msgnode:
+//   Return the pending message that should be dispatched first, NULL if no
+//   message pending. Caller must hold msg_mutex
+static struct message_node *mlooper_peek_msgnode(mlooper_handle looper)
+{
+    struct message_node *first = NULL, *node;
+    if (!list_empty(&looper->msg_list))
+        first = listnode_to_item(list_head(&looper->msg_list), struct message_node, listnode);
+    if (!list_empty(&looper->steal_list)) {
+        node = listnode_to_item(list_head(&looper->steal_list), struct message_node, listnode);
+        if (first == NULL || mlooper_msgnode_before(node, first))
+            first = node;
+    }
+    if (looper->msg_heap.size > 0) {
+        node = looper->msg_heap.nodes[0];
+        if (first == NULL || mlooper_msgnode_before(node, first))
+            first = node;
+    }
+    return first;
+}
+
+// mlooper_unlink_msgnode:
+//   Detach the pending message from msg_list or msg_heap. Caller must hold msg_mutex
+static void mlooper_unlink_msgnode(mlooper_handle looper, struct message_node *node)
+{
+    if (node->heap_index != MLOOPER_HEAP_INVALID_INDEX)
+        mlooper_heap_remove(&looper->msg_heap, node);
+    else
+        list_remove(&node->listnode);
+    mlooper_untrack_msgnode(looper, node);
+    looper->msg_count--;
+}
+
+// mlooper_remove_msgnode_if:
+//   Remove and discard all pending messages that @match returns true.
+//   Matched delayed messages are dropped from msg_heap in a single pass,
+//   then the heap is rebuilt
+static void mlooper_remove_msgnode_if(mlooper_handle looper,
+                                      bool (*match)(struct message_node *node, void *arg), void *arg)
+{
+    struct message_node *node = NULL;
+    struct listnode *item, *tmp;
+    unsigned int i, kept = 0;
+
+    os_mutex_lock(looper->msg_mutex);
+
+    mlooper_drain_inbox(looper);
+
+    list_for_each_safe(item, tmp, &looper->msg_list) {
+        node = listnode_to_item(item, struct message_node, listnode);
+        if (match(node, arg)) {
+            list_remove(item);
+            mlooper_untrack_msgnode(looper, node);
+            looper->msg_count--;
+            node->msg.state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
+        }
+    }
+
+    list_for_each_safe(item, tmp, &looper->steal_list) {
+        node = listnode_to_item(item, struct message_node, listnode);
+        if (match(node, arg)) {
+            list_remove(item);
+            mlooper_untrack_msgnode(looper, node);
+            looper->msg_count--;
+            node->msg.state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
+        }
+    }
+
+    for (i = 0; i < looper->msg_heap.size; i++) {
+        node = looper->msg_heap.nodes[i];
+        if (match(node, arg)) {
+            node->heap_index = MLOOPER_HEAP_INVALID_INDEX;
+            mlooper_untrack_msgnode(looper, node);
+            looper->msg_count--;
+            node->msg.state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
+        } else {
+            mlooper_heap_set(&looper->msg_heap, kept++, node);
+        }
+    }
+    if (kept != looper->msg_heap.size) {
+        looper->msg_heap.size = kept;
+        for (i = kept / 2; i > 0; i--)
+            mlooper_heap_sift_down(&looper->msg_heap, i - 1);
+    }
+
+    os_mutex_unlock(looper->msg_mutex);
+}
+
+// mlooper_remove_msgnode_what:
+//   Same as mlooper_remove_msgnode_if() matching @what (and owner thread if
+//   @self), but only visit the index bucket of @what if index is enabled
+static void mlooper_remove_msgnode_what(mlooper_handle looper, int what, bool self)
+{
+    struct message_node *node = NULL;
+    struct listnode *item, *tmp, *bucket;
+    os_thread owner = self ? os_thread_self() : NULL;
+
+    os_mutex_lock(looper->msg_mutex);
+
+    mlooper_drain_inbox(looper);
+
+    bucket = mlooper_index_bucket(looper, what);
+    list_for_each_safe(item, tmp, bucket) {
+        node = listnode_to_item(item, struct message_node, hashnode);
+        if (node->msg.what == what && (!self || node->owner_thread == owner)) {
+            mlooper_unlink_msgnode(looper, node);
+            node->msg.state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
+        }
+    }
+
+    os_mutex_unlock(looper->msg_mutex);
 }
 
 static void mlooper_clear_msglist(mlooper_handle looper)
@@ -78,9 +750,26 @@ static void mlooper_clear_msglist(mlooper_handle looper)
 
     os_mutex_lock(looper->msg_mutex);
 
+    mlooper_drain_inbox(looper);
     list_for_each_safe(item, tmp, &looper->msg_list) {
         node = listnode_to_item(item, struct message_node, listnode);
         list_remove(item);
+        mlooper_untrack_msgnode(looper, node);
+        node->msg.state = MESSAGE_STATE_DISCARDED;
+        mlooper_free_msgnode(looper, node);
+    }
+    list_for_each_safe(item, tmp, &looper->steal_list) {
+        node = listnode_to_item(item, struct message_node, listnode);
+        list_remove(item);
+        mlooper_untrack_msgnode(looper, node);
+        node->msg.state = MESSAGE_STATE_DISCARDED;
+        mlooper_free_msgnode(looper, node);
+    }
+    while (looper->msg_heap.size > 0) {
+        looper->msg_heap.size--;
+        node = looper->msg_heap.nodes[looper->msg_heap.size];
+        node->heap_index = MLOOPER_HEAP_INVALID_INDEX;
+        mlooper_untrack_msgnode(looper, node);
         node->msg.state = MESSAGE_STATE_DISCARDED;
         mlooper_free_msgnode(looper, node);
     }
@@ -89,73 +778,186 @@ static void mlooper_clear_msglist(mlooper_handle looper)
     os_mutex_unlock(looper->msg_mutex);
 }
 
+static void mlooper_dispatch_msgnode(mlooper_handle looper, struct message_node *node,
+                                     unsigned long long now)
+{
+    struct message *msg = &node->msg;
+    unsigned long long start = 0;
+
+    if (looper->stats != NULL)
+        start = os_monotonic_usec();
+
+    if (node->timeout > 0 && node->timeout < now) {
+        OS_LOGE(LOG_TAG, "[%s]: Timeout, discard message: what=[%d]",
+                looper->thread_name, msg->what);
+        msg->state = MESSAGE_STATE_TIMEOUT;
+        if (msg->on_timeout != NULL)
+            msg->on_timeout(msg);
+    } else {
+        if (msg->on_handle != NULL) {
+            msg->state = MESSAGE_STATE_HANDLING;
+            msg->on_handle(msg);
+            msg->state = MESSAGE_STATE_HANDLED;
+        } else if (looper->msg_handle != NULL) {
+            msg->state = MESSAGE_STATE_HANDLING;
+            looper->msg_handle(msg);
+            msg->state = MESSAGE_STATE_HANDLED;
+        } else {
+            OS_LOGW(LOG_TAG, "[%s]: No message handler: what=[%d]",
+                    looper->thread_name, msg->what);
+            msg->state = MESSAGE_STATE_DISCARDED;
+        }
+    }
+    if (looper->stats != NULL && msg->state == MESSAGE_STATE_HANDLED)
+        mlooper_stats_finish(looper, node, start, os_monotonic_usec());
+    mlooper_free_msgnode(looper, node);
+}
+
+// mlooper_run_idle_handlers:
+//   Run every idle handler once, drop those that return false.
+//   Caller must hold msg_mutex, which is released while calling handlers
+static void mlooper_run_idle_handlers(mlooper_handle looper)
+{
+    struct mlooper_idle *idle;
+    bool keep;
+
+    looper->idle_pending = false;
+    while (!list_empty(&looper->idle_list)) {
+        struct listnode *item = list_head(&looper->idle_list);
+        list_remove(item);
+        list_add_tail(&looper->idle_running, item);
+    }
+
+    while (!list_empty(&looper->idle_running)) {
+        idle = listnode_to_item(list_head(&looper->idle_running), struct mlooper_idle, listnode);
+        list_remove(&idle->listnode);
+        looper->idle_current = idle;
+        os_mutex_unlock(looper->msg_mutex);
+
+        keep = idle->on_idle(idle->arg);
+
+        os_mutex_lock(looper->msg_mutex);
+        looper->idle_current = NULL;
+        if (keep && !idle->removed)
+            list_add_tail(&looper->idle_list, &idle->listnode);
+        else
+            OS_FREE(idle);
+    }
+}
+
+static struct message_node *mlooper_pool_steal_msgnode(mlooper_handle looper);
+static unsigned int mlooper_pool_steal_seq(struct mlooper_pool *pool);
+static void mlooper_pool_park(mlooper_handle looper, unsigned long long deadline, unsigned int steal_seq);
+
 static void *mlooper_thread_entry(void *arg)
 {
     struct mlooper *looper = (struct mlooper *)arg;
     struct message_node *node = NULL;
-    struct message *msg = NULL;
-    struct listnode *front = NULL;
+    struct listnode batch_list;
+    struct listnode *item, *tmp;
+    unsigned int batch_count;
     unsigned long long now;
+    unsigned int steal_seq = 0;
+    bool steal_tried = false;
 
     OS_LOGD(LOG_TAG, "[%s]: Entry looper thread: thread_id=[%p]",
             looper->thread_name, looper->thread_id);
 
+    list_init(&batch_list);
+
     while (1) {
         {
             os_mutex_lock(looper->msg_mutex);
 
-            while (list_empty(&looper->msg_list) && !looper->thread_exit)
-                os_cond_wait(looper->msg_cond, looper->msg_mutex);
+            mlooper_drain_inbox(looper);
 
             if (looper->thread_exit) {
                 os_mutex_unlock(looper->msg_mutex);
                 break;
             }
 
-            front = list_head(&looper->msg_list);
-            node = listnode_to_item(front, struct message_node, listnode);
-            msg = &node->msg;
-
             now = os_monotonic_usec();
-            if (node->when > now) {
-                unsigned long wait = node->when - now;
-                OS_LOGV(LOG_TAG, "[%s]: Message: what=[%d], wait=[%lums], waiting",
-                        looper->thread_name, msg->what, wait/1000);
-                os_cond_timedwait(looper->msg_cond, looper->msg_mutex, wait);
-                OS_LOGV(LOG_TAG, "[%s]: Message: what=[%d], wait=[%lums], wakeup",
-                        looper->thread_name, msg->what, wait/1000);
-                msg = NULL;
+
+            // expire timed out messages wherever they are in the queue
+            batch_count = 0;
+            while (batch_count < looper->batch_size && looper->timeout_heap.size > 0 &&
+                   looper->timeout_heap.nodes[0]->timeout < now) {
+                node = looper->timeout_heap.nodes[0];
+                mlooper_unlink_msgnode(looper, node);
+                list_add_tail(&batch_list, &node->listnode);
+                batch_count++;
+            }
+
+            node = mlooper_peek_msgnode(looper);
+
+            if (batch_count > 0 || (node != NULL && node->when <= now)) {
+                // take all messages that are due, up to batch_size, with one clock read
+                while (batch_count < looper->batch_size && node != NULL && node->when <= now) {
+                    mlooper_unlink_msgnode(looper, node);
+                    list_add_tail(&batch_list, &node->listnode);
+                    batch_count++;
+                    node = mlooper_peek_msgnode(looper);
+                }
+                looper->idle_pending = true;
+                steal_tried = false;
+            } else if (looper->pool != NULL && !steal_tried) {
+                // nothing due, help other workers of the pool before sleeping
+                os_mutex_unlock(looper->msg_mutex);
+                steal_seq = mlooper_pool_steal_seq(looper->pool);
+                node = mlooper_pool_steal_msgnode(looper);
+                if (node != NULL) {
+                    mlooper_dispatch_msgnode(looper, node, os_monotonic_usec());
+                    looper->idle_pending = true;
+                } else {
+                    steal_tried = true;
+                }
+                continue;
+            } else if (looper->idle_pending && !list_empty(&looper->idle_list)) {
+                mlooper_run_idle_handlers(looper);
+                os_mutex_unlock(looper->msg_mutex);
+                continue;
+            } else if (node != NULL) {
+                // sleep until the earliest deadline, either a delayed message
+                // becomes due or a pending message times out
+                unsigned long long deadline = node->when;
+                if (looper->timeout_heap.size > 0 && looper->timeout_heap.nodes[0]->timeout < deadline)
+                    deadline = looper->timeout_heap.nodes[0]->timeout;
+                if (deadline <= now)
+                    deadline = now + 1;
+                OS_LOGV(LOG_TAG, "[%s]: Message: what=[%d], wait=[%llums], waiting",
+                        looper->thread_name, node->msg.what, (deadline - now)/1000);
+                if (looper->pool != NULL)
+                    mlooper_pool_park(looper, deadline, steal_seq);
+                else
+                    mlooper_wait_message(looper, deadline);
+                OS_LOGV(LOG_TAG, "[%s]: Message: what=[%d], wakeup",
+                        looper->thread_name, node->msg.what);
+                steal_tried = false;
+            } else if (looper->pool != NULL) {
+                mlooper_pool_park(looper, 0, steal_seq);
+                steal_tried = false;
             } else {
-                list_remove(front);
-                looper->msg_count--;
+                mlooper_wait_message(looper, 0);
+                steal_tried = false;
             }
 
             os_mutex_unlock(looper->msg_mutex);
         }
 
-        if (msg != NULL) {
-            if (node->timeout > 0 && node->timeout < now) {
-                OS_LOGE(LOG_TAG, "[%s]: Timeout, discard message: what=[%d]",
-                        looper->thread_name, msg->what);
-                msg->state = MESSAGE_STATE_TIMEOUT;
-                if (msg->on_timeout != NULL)
-                    msg->on_timeout(msg);
-            } else {
-                if (msg->on_handle != NULL) {
-                    msg->state = MESSAGE_STATE_HANDLING;
-                    msg->on_handle(msg);
-                    msg->state = MESSAGE_STATE_HANDLED;
-                } else if (looper->msg_handle != NULL) {
-                    msg->state = MESSAGE_STATE_HANDLING;
-                    looper->msg_handle(msg);
-                    msg->state = MESSAGE_STATE_HANDLED;
-                } else {
-                    OS_LOGW(LOG_TAG, "[%s]: No message handler: what=[%d]",
-                            looper->thread_name, msg->what);
-                    msg->state = MESSAGE_STATE_DISCARDED;
-                }
+        batch_count = 0;
+        list_for_each_safe(item, tmp, &batch_list) {
+            node = listnode_to_item(item, struct message_node, listnode);
+            list_remove(item);
+            if (looper->thread_exit) {
+                node->msg.state = MESSAGE_STATE_DISCARDED;
+                mlooper_free_msgnode(looper, node);
+                continue;
             }
-            mlooper_free_msgnode(looper, node);
+            // refresh clock for timeout check, it may elapse while handling previous messages
+            if (node->timeout > 0 && batch_count > 0)
+                now = os_monotonic_usec();
+            mlooper_dispatch_msgnode(looper, node, now);
+            batch_count++;
         }
     }
 
@@ -168,6 +970,18 @@ static void *mlooper_thread_entry(void *arg)
 
 mlooper_handle mlooper_create(struct os_thread_attr *attr, message_cb on_handle, message_cb on_free)
 {
+    struct mlooper_attr mattr;
+    memset(&mattr, 0x0, sizeof(mattr));
+    if (attr != NULL)
+        mattr.thread_attr = *attr;
+    else
+        mattr.thread_attr.priority = OS_THREAD_PRIO_NORMAL;
+    return mlooper_create_with_attr(&mattr, on_handle, on_free);
+}
+
+mlooper_handle mlooper_create_with_attr(struct mlooper_attr *mattr, message_cb on_handle, message_cb on_free)
+{
+    struct os_thread_attr *attr = mattr != NULL ? &mattr->thread_attr : NULL;
     struct mlooper *looper = OS_CALLOC(1, sizeof(struct mlooper));
     if (looper == NULL) {
         OS_LOGE(LOG_TAG, "Failed to allocate looper");
@@ -193,6 +1007,14 @@ mlooper_handle mlooper_create(struct os_thread_attr *attr, message_cb on_handle,
     }
 
     list_init(&looper->msg_list);
+    list_init(&looper->steal_list);
+    list_init(&looper->idle_list);
+    list_init(&looper->idle_running);
+    looper->idle_pending = true;
+    memset(&looper->msg_heap, 0x0, sizeof(looper->msg_heap));
+    memset(&looper->timeout_heap, 0x0, sizeof(looper->timeout_heap));
+    looper->timeout_heap.by_timeout = true;
+    looper->msg_seq = 0;
     looper->msg_count = 0;
     looper->msg_handle = on_handle;
     looper->msg_free = on_free;
@@ -209,9 +1031,71 @@ mlooper_handle mlooper_create(struct os_thread_attr *attr, message_cb on_handle,
         looper->thread_attr.stacksize = os_thread_default_stacksize();
         looper->thread_attr.joinable = true;
     }
+
+    looper->batch_size = (mattr != NULL && mattr->batch_size > 1) ? mattr->batch_size : 1;
+
+    if (mattr != NULL && mattr->pool_capacity > 0) {
+        struct mlooper_node_pool *pool = &looper->node_pool;
+        unsigned int class;
+        pool->lock = os_mutex_create();
+        if (pool->lock == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to create pool lock");
+            goto fail_create;
+        }
+        for (class = 0; class < MLOOPER_NODE_POOL_CLASS_COUNT; class++)
+            list_init(&pool->free_list[class]);
+        pool->capacity = mattr->pool_capacity;
+    }
+
+    if (mattr != NULL && mattr->index_buckets > 0) {
+        unsigned int buckets = 1, i;
+        while (buckets < mattr->index_buckets)
+            buckets <<= 1;
+        looper->msg_index = OS_MALLOC(buckets * sizeof(struct listnode));
+        if (looper->msg_index == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to allocate message index");
+            goto fail_create;
+        }
+        for (i = 0; i < buckets; i++)
+            list_init(&looper->msg_index[i]);
+        looper->msg_index_mask = buckets - 1;
+    }
+
+    if (mattr != NULL && (mattr->flags & MLOOPER_FLAG_STATS)) {
+        looper->stats_mutex = os_mutex_create();
+        if (looper->stats_mutex == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to create stats_mutex");
+            goto fail_create;
+        }
+        looper->stats = OS_CALLOC(1, sizeof(struct mlooper_stats));
+        if (looper->stats == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to allocate stats");
+            goto fail_create;
+        }
+    }
+
+    if (mattr != NULL && (mattr->flags & MLOOPER_FLAG_LOCKFREE_POST)) {
+#if defined(MLOOPER_HAVE_ATOMIC)
+        looper->lockfree_post = true;
+        atomic_init(&looper->inbox, NULL);
+        atomic_init(&looper->inbox_count, 0);
+        atomic_init(&looper->sleeping, false);
+#else
+        OS_LOGW(LOG_TAG, "[%s]: Atomic not supported, lock-free posting disabled", looper->thread_name);
+#endif
+    }
     return looper;
 
 fail_create:
+    if (looper->msg_index != NULL)
+        OS_FREE(looper->msg_index);
+    if (looper->stats != NULL)
+        OS_FREE(looper->stats);
+    if (looper->stats_mutex != NULL)
+        os_mutex_destroy(looper->stats_mutex);
+    mlooper_node_pool_deinit(&looper->node_pool);
+    if (looper->thread_name != NULL)
+        OS_FREE(looper->thread_name);
     if (looper->thread_mutex != NULL)
         os_mutex_destroy(looper->thread_mutex);
     if (looper->msg_cond != NULL)
@@ -253,6 +1137,8 @@ int mlooper_post_message_front(mlooper_handle looper, struct message *msg)
     struct message_node *front;
 
     node->when = now;
+    node->seq = 0; // sort before any message that has the same @when
+    node->heap_index = MLOOPER_HEAP_INVALID_INDEX;
     node->owner_thread = os_thread_self();
     msg->state = MESSAGE_STATE_PENDING;
     if (msg->timeout_ms > 0)
@@ -261,12 +1147,14 @@ int mlooper_post_message_front(mlooper_handle looper, struct message *msg)
     {
         os_mutex_lock(looper->msg_mutex);
 
-        if (!list_empty(&looper->msg_list)) {
-            front = listnode_to_item(list_head(&looper->msg_list), struct message_node, listnode);
+        mlooper_drain_inbox(looper);
+        front = mlooper_peek_msgnode(looper);
+        if (front != NULL)
             node->when = now < front->when ? now : front->when;
-        }
         list_add_head(&looper->msg_list, &node->listnode);
+        mlooper_track_msgnode(looper, node);
         looper->msg_count++;
+        mlooper_stats_depth(looper);
 
         os_cond_signal(looper->msg_cond);
 
@@ -275,157 +1163,407 @@ int mlooper_post_message_front(mlooper_handle looper, struct message *msg)
     return 0;
 }
 
-int mlooper_post_message_delay(mlooper_handle looper, struct message *msg, unsigned long msec)
+// mlooper_prepare_msgnode:
+//   Stamp the message to be posted @msec later, discard it and return -1 if
+//   its timeout is earlier than the delay
+static int mlooper_prepare_msgnode(mlooper_handle looper, struct message_node *node,
+                                   unsigned long long now, unsigned long msec)
+{
+    struct message *msg = &node->msg;
+
+    node->when = now + msec*1000;
+    node->heap_index = MLOOPER_HEAP_INVALID_INDEX;
+    node->owner_thread = os_thread_self();
+    msg->state = MESSAGE_STATE_PENDING;
+    if (msg->timeout_ms > 0) {
+        if (msg->timeout_ms <= msec) {
+            OS_LOGE(LOG_TAG, "[%s]: timeout_ms <= delay_ms, discard message: what=[%d]",
+                    looper->thread_name, msg->what);
+            msg->state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
+            return -1;
+        } else {
+            node->timeout = now + msg->timeout_ms * 1000;
+        }
+    }
+    return 0;
+}
+
+// mlooper_enqueue_msgnode:
+//   Queue the prepared message to @list if it's due, to msg_heap if delayed.
+//   Caller must hold msg_mutex
+static int mlooper_enqueue_msgnode(mlooper_handle looper, struct message_node *node,
+                                   struct listnode *list, unsigned long msec)
+{
+    struct message_node *tail;
+
+    node->seq = ++looper->msg_seq;
+    if (msec == 0) {
+        // keep the list sorted even if posters race on reading the clock
+        if (!list_empty(list)) {
+            tail = listnode_to_item(list_tail(list), struct message_node, listnode);
+            if (node->when < tail->when)
+                node->when = tail->when;
+        }
+        list_add_tail(list, &node->listnode);
+    } else if (mlooper_heap_push(&looper->msg_heap, node) != 0) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to grow message heap", looper->thread_name);
+        return -1;
+    }
+    mlooper_track_msgnode(looper, node);
+    looper->msg_count++;
+    mlooper_stats_depth(looper);
+    return 0;
+}
+
+static int mlooper_post_msgnode(mlooper_handle looper, struct message *msg, unsigned long msec, bool stealable)
 {
-    unsigned long long now = os_monotonic_usec();
     struct message_node *node = (struct message_node *)msg;
-    struct message_node *temp;
+    struct listnode *list = stealable ? &looper->steal_list : &looper->msg_list;
+
+    if (mlooper_prepare_msgnode(looper, node, os_monotonic_usec(), msec) != 0)
+        return -1;
+
+#if defined(MLOOPER_HAVE_ATOMIC)
+    if (msec == 0 && !stealable && looper->lockfree_post) {
+        struct listnode *head = atomic_load_explicit(&looper->inbox, memory_order_relaxed);
+        atomic_fetch_add(&looper->inbox_count, 1);
+        do {
+            node->listnode.next = head;
+        } while (!atomic_compare_exchange_weak(&looper->inbox, &head, &node->listnode));
+
+        if (atomic_load(&looper->sleeping)) {
+            os_mutex_lock(looper->msg_mutex);
+            os_cond_signal(looper->msg_cond);
+            os_mutex_unlock(looper->msg_mutex);
+        }
+        return 0;
+    }
+#endif
+
+    {
+        os_mutex_lock(looper->msg_mutex);
+
+        if (mlooper_enqueue_msgnode(looper, node, list, msec) != 0) {
+            os_mutex_unlock(looper->msg_mutex);
+            msg->state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
+            return -1;
+        }
+
+        os_cond_signal(looper->msg_cond);
+
+        os_mutex_unlock(looper->msg_mutex);
+    }
+    return 0;
+}
+
+int mlooper_post_message_delay(mlooper_handle looper, struct message *msg, unsigned long msec)
+{
+    return mlooper_post_msgnode(looper, msg, msec, false);
+}
+
+// mlooper_find_msgnode_what:
+//   Return the first pending message with @what, via index if enabled.
+//   Caller must hold msg_mutex and drain inbox
+static struct message_node *mlooper_find_msgnode_what(mlooper_handle looper, int what)
+{
+    struct message_node *node;
     struct listnode *item;
+    unsigned int i;
+
+    if (looper->msg_index != NULL) {
+        list_for_each(item, mlooper_index_bucket(looper, what)) {
+            node = listnode_to_item(item, struct message_node, hashnode);
+            if (node->msg.what == what)
+                return node;
+        }
+        return NULL;
+    }
+
+    list_for_each(item, &looper->msg_list) {
+        node = listnode_to_item(item, struct message_node, listnode);
+        if (node->msg.what == what)
+            return node;
+    }
+    list_for_each(item, &looper->steal_list) {
+        node = listnode_to_item(item, struct message_node, listnode);
+        if (node->msg.what == what)
+            return node;
+    }
+    for (i = 0; i < looper->msg_heap.size; i++) {
+        if (looper->msg_heap.nodes[i]->msg.what == what)
+            return looper->msg_heap.nodes[i];
+    }
+    return NULL;
+}
+
+int mlooper_post_message_coalesce(mlooper_handle looper, struct message *msg, unsigned long msec,
+                                  enum mlooper_coalesce_policy policy)
+{
+    struct message_node *node = (struct message_node *)msg;
+    struct message_node *pending;
+    int ret = 0;
+
+    if (mlooper_prepare_msgnode(looper, node, os_monotonic_usec(), msec) != 0)
+        return -1;
+
+    os_mutex_lock(looper->msg_mutex);
+
+    mlooper_drain_inbox(looper);
+
+    pending = mlooper_find_msgnode_what(looper, msg->what);
+    if (pending != NULL && policy == MLOOPER_COALESCE_REPLACE &&
+        node->timeout > 0 && node->timeout <= pending->when) {
+        // new message would time out before the schedule of pending one,
+        // drop pending one and queue new message with its own schedule
+        mlooper_unlink_msgnode(looper, pending);
+        pending->msg.state = MESSAGE_STATE_DISCARDED;
+        mlooper_free_msgnode(looper, pending);
+        pending = NULL;
+    }
+
+    if (pending == NULL) {
+        if (mlooper_enqueue_msgnode(looper, node, &looper->msg_list, msec) != 0) {
+            os_mutex_unlock(looper->msg_mutex);
+            msg->state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
+            return -1;
+        }
+        os_cond_signal(looper->msg_cond);
+    } else if (policy == MLOOPER_COALESCE_REPLACE) {
+        // take over the slot of pending message, so queue order is untouched
+        node->when = pending->when;
+        node->seq = pending->seq;
+        node->heap_index = pending->heap_index;
+        if (node->heap_index != MLOOPER_HEAP_INVALID_INDEX) {
+            looper->msg_heap.nodes[node->heap_index] = node;
+        } else {
+            list_add_after(&pending->listnode, &node->listnode);
+            list_remove(&pending->listnode);
+        }
+        mlooper_track_msgnode(looper, node);
+        mlooper_untrack_msgnode(looper, pending);
+        pending->heap_index = MLOOPER_HEAP_INVALID_INDEX;
+        pending->msg.state = MESSAGE_STATE_DISCARDED;
+        mlooper_free_msgnode(looper, pending);
+        // timeout of new message may be the earliest deadline now
+        os_cond_signal(looper->msg_cond);
+    } else {
+        msg->state = MESSAGE_STATE_DISCARDED;
+        mlooper_free_msgnode(looper, node);
+        ret = 1;
+    }
+
+    os_mutex_unlock(looper->msg_mutex);
+    return ret;
+}
+
+int mlooper_send_message_sync(mlooper_handle looper, struct message *msg, int *result)
+{
+    struct message_node *node = (struct message_node *)msg;
+    struct mlooper_waiter inline_waiter, *waiter;
+    bool cached = false;
+    int ret;
+
+    if (!looper->thread_exit && looper->thread_id == os_thread_self()) {
+        // called from handler of this looper, waiting for looper itself would deadlock
+        unsigned long long now = os_monotonic_usec();
+        memset(&inline_waiter, 0x0, sizeof(inline_waiter));
+        node->waiter = &inline_waiter;
+        if (mlooper_prepare_msgnode(looper, node, now, 0) == 0)
+            mlooper_dispatch_msgnode(looper, node, now);
+        if (result != NULL)
+            *result = inline_waiter.result;
+        return inline_waiter.handled ? 0 : -1;
+    }
 
-    node->when = now + msec*1000;
-    node->owner_thread = os_thread_self();
-    msg->state = MESSAGE_STATE_PENDING;
-    if (msg->timeout_ms > 0) {
-        if (msg->timeout_ms <= msec) {
-            OS_LOGE(LOG_TAG, "[%s]: timeout_ms <= delay_ms, discard message: what=[%d]",
+    waiter = mlooper_waiter_acquire(&cached);
+    if (waiter == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to create waiter", looper->thread_name);
+        msg->state = MESSAGE_STATE_DISCARDED;
+        mlooper_free_msgnode(looper, node);
+        return -1;
+    }
+    waiter->done = false;
+    waiter->handled = false;
+    waiter->result = 0;
+    node->waiter = waiter;
+
+    // waiter is woken even if the message is discarded by posting. Fail fast
+    // if looper isn't running, thread_exit is checked with msg_mutex held as
+    // mlooper_stop() sets it, later messages are discarded by looper thread
+    if (mlooper_prepare_msgnode(looper, node, os_monotonic_usec(), 0) == 0) {
+        os_mutex_lock(looper->msg_mutex);
+        // messages posted lock-free before this one go first
+        if (!looper->thread_exit)
+            mlooper_drain_inbox(looper);
+        if (looper->thread_exit) {
+            os_mutex_unlock(looper->msg_mutex);
+            OS_LOGE(LOG_TAG, "[%s]: Looper isn't running, discard sync message: what=[%d]",
                     looper->thread_name, msg->what);
             msg->state = MESSAGE_STATE_DISCARDED;
             mlooper_free_msgnode(looper, node);
-            return -1;
+        } else if (mlooper_enqueue_msgnode(looper, node, &looper->msg_list, 0) != 0) {
+            os_mutex_unlock(looper->msg_mutex);
+            msg->state = MESSAGE_STATE_DISCARDED;
+            mlooper_free_msgnode(looper, node);
         } else {
-            node->timeout = now + msg->timeout_ms * 1000;
+            os_cond_signal(looper->msg_cond);
+            os_mutex_unlock(looper->msg_mutex);
         }
     }
 
-    {
-        os_mutex_lock(looper->msg_mutex);
+    os_mutex_lock(waiter->mutex);
+    while (!waiter->done)
+        os_cond_wait(waiter->cond, waiter->mutex);
+    os_mutex_unlock(waiter->mutex);
 
-        list_for_each_reverse(item, &looper->msg_list) {
-            temp = listnode_to_item(item, struct message_node, listnode);
-            if (node->when >= temp->when) {
-                list_add_after(&temp->listnode, &node->listnode);
-                looper->msg_count++;
-                break;
-            }
-        }
-        if (item == &looper->msg_list) {
-            list_add_head(&looper->msg_list, &node->listnode);
-            looper->msg_count++;
-        }
+    if (result != NULL)
+        *result = waiter->result;
+    ret = waiter->handled ? 0 : -1;
+    mlooper_waiter_release(waiter, cached);
+    return ret;
+}
 
-        os_cond_signal(looper->msg_cond);
+static bool mlooper_match_self_what(struct message_node *node, void *arg)
+{
+    return node->msg.what == *(int *)arg && node->owner_thread == os_thread_self();
+}
 
-        os_mutex_unlock(looper->msg_mutex);
-    }
-    return 0;
+static bool mlooper_match_self_if(struct message_node *node, void *arg)
+{
+    bool (*on_match)(struct message *msg) = (bool (*)(struct message *))arg;
+    return on_match(&node->msg) && node->owner_thread == os_thread_self();
 }
 
-int mlooper_remove_self_message(mlooper_handle looper, int what)
+static bool mlooper_match_self(struct message_node *node, void *arg)
 {
-    struct message_node *node = NULL;
-    struct listnode *item, *tmp;
-    os_thread self = os_thread_self();
+    return node->owner_thread == os_thread_self();
+}
 
-    os_mutex_lock(looper->msg_mutex);
-    list_for_each_safe(item, tmp, &looper->msg_list) {
-        node = listnode_to_item(item, struct message_node, listnode);
-        if (node->msg.what == what && self == node->owner_thread) {
-            list_remove(item);
-            node->msg.state = MESSAGE_STATE_DISCARDED;
-            mlooper_free_msgnode(looper, node);
-            looper->msg_count--;
-        }
+static bool mlooper_match_what(struct message_node *node, void *arg)
+{
+    return node->msg.what == *(int *)arg;
+}
+
+static bool mlooper_match_if(struct message_node *node, void *arg)
+{
+    bool (*on_match)(struct message *msg) = (bool (*)(struct message *))arg;
+    return on_match(&node->msg);
+}
+
+int mlooper_remove_self_message(mlooper_handle looper, int what)
+{
+    if (looper->msg_index != NULL) {
+        mlooper_remove_msgnode_what(looper, what, true);
+        return 0;
     }
-    os_mutex_unlock(looper->msg_mutex);
+    mlooper_remove_msgnode_if(looper, mlooper_match_self_what, &what);
     return 0;
 }
 
 int mlooper_remove_self_message_if(mlooper_handle looper, bool (*on_match)(struct message *msg))
 {
-    struct message_node *node = NULL;
-    struct listnode *item, *tmp;
-    os_thread self = os_thread_self();
-
-    os_mutex_lock(looper->msg_mutex);
-    list_for_each_safe(item, tmp, &looper->msg_list) {
-        node = listnode_to_item(item, struct message_node, listnode);
-        if (on_match(&node->msg) && self == node->owner_thread) {
-            list_remove(item);
-            node->msg.state = MESSAGE_STATE_DISCARDED;
-            mlooper_free_msgnode(looper, node);
-            looper->msg_count--;
-        }
-    }
-    os_mutex_unlock(looper->msg_mutex);
+    mlooper_remove_msgnode_if(looper, mlooper_match_self_if, (void *)on_match);
     return 0;
 }
 
 int mlooper_clear_self_message(mlooper_handle looper)
 {
-    struct message_node *node = NULL;
-    struct listnode *item, *tmp;
-    os_thread self = os_thread_self();
+    mlooper_remove_msgnode_if(looper, mlooper_match_self, NULL);
+    return 0;
+}
 
-    os_mutex_lock(looper->msg_mutex);
-    list_for_each_safe(item, tmp, &looper->msg_list) {
-        node = listnode_to_item(item, struct message_node, listnode);
-        if (self == node->owner_thread) {
-            list_remove(item);
-            node->msg.state = MESSAGE_STATE_DISCARDED;
-            mlooper_free_msgnode(looper, node);
-            looper->msg_count--;
-        }
+int mlooper_remove_message(mlooper_handle looper, int what)
+{
+    if (looper->msg_index != NULL) {
+        mlooper_remove_msgnode_what(looper, what, false);
+        return 0;
     }
-    os_mutex_unlock(looper->msg_mutex);
+    mlooper_remove_msgnode_if(looper, mlooper_match_what, &what);
     return 0;
 }
 
-int mlooper_remove_message(mlooper_handle looper, int what)
+int mlooper_remove_message_if(mlooper_handle looper, bool (*on_match)(struct message *msg))
 {
-    struct message_node *node = NULL;
-    struct listnode *item, *tmp;
+    mlooper_remove_msgnode_if(looper, mlooper_match_if, (void *)on_match);
+    return 0;
+}
 
-    os_mutex_lock(looper->msg_mutex);
-    list_for_each_safe(item, tmp, &looper->msg_list) {
-        node = listnode_to_item(item, struct message_node, listnode);
-        if (node->msg.what == what) {
-            list_remove(item);
-            node->msg.state = MESSAGE_STATE_DISCARDED;
-            mlooper_free_msgnode(looper, node);
-            looper->msg_count--;
-        }
+int mlooper_clear_message(mlooper_handle looper)
+{
+    mlooper_clear_msglist(looper);
+    return 0;
+}
+
+int mlooper_add_idle_handler(mlooper_handle looper, bool (*on_idle)(void *arg), void *arg)
+{
+    struct mlooper_idle *idle = OS_CALLOC(1, sizeof(struct mlooper_idle));
+    if (idle == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to allocate idle handler", looper->thread_name);
+        return -1;
     }
+    idle->on_idle = on_idle;
+    idle->arg = arg;
+
+    os_mutex_lock(looper->msg_mutex);
+    list_add_tail(&looper->idle_list, &idle->listnode);
+    looper->idle_pending = true;
+    os_cond_signal(looper->msg_cond);
     os_mutex_unlock(looper->msg_mutex);
     return 0;
 }
 
-int mlooper_remove_message_if(mlooper_handle looper, bool (*on_match)(struct message *msg))
+int mlooper_remove_idle_handler(mlooper_handle looper, bool (*on_idle)(void *arg), void *arg)
 {
-    struct message_node *node = NULL;
+    struct listnode *lists[2] = { &looper->idle_list, &looper->idle_running };
+    struct mlooper_idle *idle;
     struct listnode *item, *tmp;
+    unsigned int i;
 
     os_mutex_lock(looper->msg_mutex);
-    list_for_each_safe(item, tmp, &looper->msg_list) {
-        node = listnode_to_item(item, struct message_node, listnode);
-        if (on_match(&node->msg)) {
-            list_remove(item);
-            node->msg.state = MESSAGE_STATE_DISCARDED;
-            mlooper_free_msgnode(looper, node);
-            looper->msg_count--;
+    for (i = 0; i < 2; i++) {
+        list_for_each_safe(item, tmp, lists[i]) {
+            idle = listnode_to_item(item, struct mlooper_idle, listnode);
+            if (idle->on_idle == on_idle && idle->arg == arg) {
+                list_remove(item);
+                OS_FREE(idle);
+            }
         }
     }
+    idle = looper->idle_current;
+    if (idle != NULL && idle->on_idle == on_idle && idle->arg == arg)
+        idle->removed = true;
     os_mutex_unlock(looper->msg_mutex);
     return 0;
 }
 
-int mlooper_clear_message(mlooper_handle looper)
+int mlooper_get_stats(mlooper_handle looper, struct mlooper_stats *stats)
 {
-    mlooper_clear_msglist(looper);
+    if (looper->stats == NULL)
+        return -1;
+    os_mutex_lock(looper->stats_mutex);
+    memcpy(stats, looper->stats, sizeof(struct mlooper_stats));
+    os_mutex_unlock(looper->stats_mutex);
     return 0;
 }
 
+void mlooper_reset_stats(mlooper_handle looper)
+{
+    if (looper->stats == NULL)
+        return;
+    os_mutex_lock(looper->stats_mutex);
+    memset(looper->stats, 0x0, sizeof(struct mlooper_stats));
+    os_mutex_unlock(looper->stats_mutex);
+}
+
 unsigned int mlooper_message_count(mlooper_handle looper)
 {
+#if defined(MLOOPER_HAVE_ATOMIC)
+    if (looper->lockfree_post)
+        return looper->msg_count + atomic_load(&looper->inbox_count);
+#endif
     return looper->msg_count;
 }
 
@@ -433,16 +1571,42 @@ void mlooper_dump(mlooper_handle looper)
 {
     struct message_node *node = NULL;
     struct listnode *item;
+    unsigned int j;
     int i = 0;
 
     os_mutex_lock(looper->msg_mutex);
 
+    mlooper_drain_inbox(looper);
+
     OS_LOGI(LOG_TAG, "Dump looper thread:");
     OS_LOGI(LOG_TAG, " > thread_name=[%s]", looper->thread_name);
     OS_LOGI(LOG_TAG, " > thread_exit=[%s]", looper->thread_exit ? "true" : "false");
     OS_LOGI(LOG_TAG, " > message_count=[%u]", looper->msg_count);
 
-    if (looper->msg_count != 0) {
+    if (looper->node_pool.lock != NULL) {
+        struct mlooper_node_pool *pool = &looper->node_pool;
+        os_mutex_lock(pool->lock);
+        OS_LOGI(LOG_TAG, " > node_pool: cached=[%u], capacity=[%u], hits=[%llu], misses=[%llu]",
+                pool->cached, pool->capacity, pool->hits, pool->misses);
+        os_mutex_unlock(pool->lock);
+    }
+
+    if (looper->stats != NULL) {
+        struct mlooper_stats *stats = looper->stats;
+        os_mutex_lock(looper->stats_mutex);
+        OS_LOGI(LOG_TAG, " > stats: max_depth=[%u], avg_depth=[%llu], handled=[%llu], timeout=[%llu], discarded=[%llu]",
+                stats->max_depth,
+                stats->depth_samples > 0 ? stats->depth_sum / stats->depth_samples : 0,
+                stats->total.handling.count, stats->total.timeout_count, stats->total.discard_count);
+        OS_LOGI(LOG_TAG, " > stats: latency avg=[%lluus], max=[%lluus], handling avg=[%lluus], max=[%lluus]",
+                stats->total.latency.count > 0 ? stats->total.latency.sum_usec / stats->total.latency.count : 0,
+                stats->total.latency.max_usec,
+                stats->total.handling.count > 0 ? stats->total.handling.sum_usec / stats->total.handling.count : 0,
+                stats->total.handling.max_usec);
+        os_mutex_unlock(looper->stats_mutex);
+    }
+
+    if (!list_empty(&looper->msg_list)) {
         OS_LOGI(LOG_TAG, " > message list info:");
         list_for_each(item, &looper->msg_list) {
             node = listnode_to_item(item, struct message_node, listnode);
@@ -452,6 +1616,27 @@ void mlooper_dump(mlooper_handle looper)
         }
     }
 
+    if (!list_empty(&looper->steal_list)) {
+        OS_LOGI(LOG_TAG, " > stealable message info:");
+        list_for_each(item, &looper->steal_list) {
+            node = listnode_to_item(item, struct message_node, listnode);
+            i++;
+            OS_LOGI(LOG_TAG, "   > [%d]: owner=[%p], what=[%d], arg1=[%d], arg2=[%d], when=[%llu]",
+                    i, node->owner_thread, node->msg.what, node->msg.arg1, node->msg.arg2, node->when);
+        }
+    }
+
+    if (looper->msg_heap.size != 0) {
+        // heap order, not dispatch order
+        OS_LOGI(LOG_TAG, " > delayed message info:");
+        for (j = 0; j < looper->msg_heap.size; j++) {
+            node = looper->msg_heap.nodes[j];
+            i++;
+            OS_LOGI(LOG_TAG, "   > [%d]: owner=[%p], what=[%d], arg1=[%d], arg2=[%d], when=[%llu]",
+                    i, node->owner_thread, node->msg.what, node->msg.arg1, node->msg.arg2, node->when);
+        }
+    }
+
     os_mutex_unlock(looper->msg_mutex);
 }
 
@@ -483,10 +1668,295 @@ void mlooper_destroy(mlooper_handle looper)
     os_cond_destroy(looper->msg_cond);
     os_mutex_destroy(looper->msg_mutex);
 
+    mlooper_node_pool_deinit(&looper->node_pool);
+    if (looper->stats != NULL) {
+        OS_FREE(looper->stats);
+        os_mutex_destroy(looper->stats_mutex);
+    }
+    while (!list_empty(&looper->idle_list)) {
+        struct mlooper_idle *idle =
+            listnode_to_item(list_head(&looper->idle_list), struct mlooper_idle, listnode);
+        list_remove(&idle->listnode);
+        OS_FREE(idle);
+    }
+    if (looper->msg_index != NULL)
+        OS_FREE(looper->msg_index);
+    if (looper->msg_heap.nodes != NULL)
+        OS_FREE(looper->msg_heap.nodes);
+    if (looper->timeout_heap.nodes != NULL)
+        OS_FREE(looper->timeout_heap.nodes);
     OS_FREE(looper->thread_name);
     OS_FREE(looper);
 }
 
+struct mlooper_pool {
+    struct mlooper **workers;
+    unsigned int worker_count;
+    // following are protected by lock, lock order is worker msg_mutex first
+    os_mutex lock;
+    unsigned int next_worker; // round-robin cursor
+    unsigned int steal_seq;   // bumped each time a stealable message is posted
+};
+
+// mlooper_pool_steal_seq:
+//   Snapshot steal_seq before a steal attempt, see mlooper_pool_park()
+static unsigned int mlooper_pool_steal_seq(struct mlooper_pool *pool)
+{
+    unsigned int seq;
+    os_mutex_lock(pool->lock);
+    seq = pool->steal_seq;
+    os_mutex_unlock(pool->lock);
+    return seq;
+}
+
+// mlooper_pool_park:
+//   Park worker until its own message arrives, @deadline or a stealable
+//   message is posted to another worker. Caller must hold msg_mutex.
+//   @steal_seq is snapshot before the last failed steal attempt, if it's
+//   changed, something may have been posted after that attempt scanned its
+//   victim, return to steal again instead of parking. Otherwise the worker
+//   is marked idle under pool lock, and posters that bump steal_seq later
+//   find it and signal it under msg_mutex, which is held until cond wait
+static void mlooper_pool_park(mlooper_handle looper, unsigned long long deadline, unsigned int steal_seq)
+{
+    struct mlooper_pool *pool = looper->pool;
+
+    os_mutex_lock(pool->lock);
+    if (pool->steal_seq != steal_seq) {
+        os_mutex_unlock(pool->lock);
+        return;
+    }
+    looper->idle = true;
+    os_mutex_unlock(pool->lock);
+
+    mlooper_wait_message(looper, deadline);
+
+    os_mutex_lock(pool->lock);
+    looper->idle = false;
+    os_mutex_unlock(pool->lock);
+}
+
+// mlooper_pool_steal_msgnode:
+//   Take a plain message from the tail of another worker's steal_list.
+//   Caller must not hold its own msg_mutex, victims are locked one by one
+static struct message_node *mlooper_pool_steal_msgnode(mlooper_handle looper)
+{
+    struct mlooper_pool *pool = looper->pool;
+    struct message_node *node = NULL;
+    struct mlooper *victim;
+    unsigned int i, index = 0;
+
+    for (i = 0; i < pool->worker_count; i++) {
+        if (pool->workers[i] == looper) {
+            index = i;
+            break;
+        }
+    }
+
+    for (i = 1; i < pool->worker_count && node == NULL; i++) {
+        victim = pool->workers[(index + i) % pool->worker_count];
+        os_mutex_lock(victim->msg_mutex);
+        if (!list_empty(&victim->steal_list)) {
+            node = listnode_to_item(list_tail(&victim->steal_list), struct message_node, listnode);
+            mlooper_unlink_msgnode(victim, node);
+        }
+        os_mutex_unlock(victim->msg_mutex);
+    }
+    return node;
+}
+
+mlooper_pool_handle mlooper_pool_create(struct os_thread_attr *attr, unsigned int thread_count,
+                                        message_cb on_handle, message_cb on_free)
+{
+    struct mlooper_attr mattr;
+    char name[64];
+    unsigned int i;
+
+    if (thread_count == 0) {
+        OS_LOGE(LOG_TAG, "Invalid thread count");
+        return NULL;
+    }
+
+    struct mlooper_pool *pool = OS_CALLOC(1, sizeof(struct mlooper_pool));
+    if (pool == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate looper pool");
+        return NULL;
+    }
+    pool->workers = OS_CALLOC(thread_count, sizeof(struct mlooper *));
+    if (pool->workers == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate looper pool workers");
+        OS_FREE(pool);
+        return NULL;
+    }
+    pool->lock = os_mutex_create();
+    if (pool->lock == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper pool lock");
+        OS_FREE(pool->workers);
+        OS_FREE(pool);
+        return NULL;
+    }
+
+    memset(&mattr, 0x0, sizeof(mattr));
+    if (attr != NULL)
+        mattr.thread_attr = *attr;
+    else
+        mattr.thread_attr.priority = OS_THREAD_PRIO_NORMAL;
+
+    for (i = 0; i < thread_count; i++) {
+        snprintf(name, sizeof(name), "%s-%u",
+                 (attr && attr->name) ? attr->name : "mlooper_pool", i);
+        mattr.thread_attr.name = name;
+        pool->workers[i] = mlooper_create_with_attr(&mattr, on_handle, on_free);
+        if (pool->workers[i] == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to create looper pool worker");
+            goto fail_create;
+        }
+        pool->workers[i]->pool = pool;
+        pool->worker_count++;
+    }
+    return pool;
+
+fail_create:
+    for (i = 0; i < pool->worker_count; i++)
+        mlooper_destroy(pool->workers[i]);
+    os_mutex_destroy(pool->lock);
+    OS_FREE(pool->workers);
+    OS_FREE(pool);
+    return NULL;
+}
+
+void mlooper_pool_destroy(mlooper_pool_handle pool)
+{
+    unsigned int i;
+
+    // stop all workers first, no worker steals from a destroyed one
+    mlooper_pool_stop(pool);
+    for (i = 0; i < pool->worker_count; i++)
+        mlooper_destroy(pool->workers[i]);
+    os_mutex_destroy(pool->lock);
+    OS_FREE(pool->workers);
+    OS_FREE(pool);
+}
+
+int mlooper_pool_start(mlooper_pool_handle pool)
+{
+    unsigned int i;
+    for (i = 0; i < pool->worker_count; i++) {
+        if (mlooper_start(pool->workers[i]) != 0) {
+            mlooper_pool_stop(pool);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void mlooper_pool_stop(mlooper_pool_handle pool)
+{
+    unsigned int i;
+    for (i = 0; i < pool->worker_count; i++)
+        mlooper_stop(pool->workers[i]);
+}
+
+unsigned int mlooper_pool_message_count(mlooper_pool_handle pool)
+{
+    unsigned int i, count = 0;
+    for (i = 0; i < pool->worker_count; i++)
+        count += mlooper_message_count(pool->workers[i]);
+    return count;
+}
+
+void mlooper_pool_dump(mlooper_pool_handle pool)
+{
+    unsigned int i;
+    OS_LOGI(LOG_TAG, "Dump looper pool: worker_count=[%u]", pool->worker_count);
+    for (i = 0; i < pool->worker_count; i++)
+        mlooper_dump(pool->workers[i]);
+}
+
+// mlooper_pool_pick_worker:
+//   Prefer an idle worker, else round-robin. Picked idle worker is marked
+//   busy, as the post wakes it up, so other posts don't pick it again.
+//   @was_idle returns whether the picked worker was idle
+static struct mlooper *mlooper_pool_pick_worker(mlooper_pool_handle pool, bool *was_idle)
+{
+    struct mlooper *worker;
+    unsigned int start, i;
+
+    os_mutex_lock(pool->lock);
+    start = pool->next_worker++;
+    for (i = 0; i < pool->worker_count; i++) {
+        worker = pool->workers[(start + i) % pool->worker_count];
+        if (worker->idle) {
+            worker->idle = false;
+            os_mutex_unlock(pool->lock);
+            if (was_idle != NULL)
+                *was_idle = true;
+            return worker;
+        }
+    }
+    os_mutex_unlock(pool->lock);
+    if (was_idle != NULL)
+        *was_idle = false;
+    return pool->workers[start % pool->worker_count];
+}
+
+// mlooper_pool_notify_stealable:
+//   Called after a stealable message is queued to @busy, bump steal_seq so
+//   workers that are about to park steal again, and if @wake is set, wake
+//   up one idle worker other than @busy to steal it
+static void mlooper_pool_notify_stealable(mlooper_pool_handle pool, struct mlooper *busy, bool wake)
+{
+    struct mlooper *worker = NULL;
+    unsigned int i;
+
+    os_mutex_lock(pool->lock);
+    pool->steal_seq++;
+    for (i = 0; wake && i < pool->worker_count; i++) {
+        if (pool->workers[i] != busy && pool->workers[i]->idle) {
+            worker = pool->workers[i];
+            worker->idle = false;
+            break;
+        }
+    }
+    os_mutex_unlock(pool->lock);
+
+    if (worker != NULL) {
+        os_mutex_lock(worker->msg_mutex);
+        os_cond_signal(worker->msg_cond);
+        os_mutex_unlock(worker->msg_mutex);
+    }
+}
+
+int mlooper_pool_post_message(mlooper_pool_handle pool, struct message *msg)
+{
+    bool was_idle;
+    struct mlooper *worker = mlooper_pool_pick_worker(pool, &was_idle);
+
+    if (mlooper_post_msgnode(worker, msg, 0, true) != 0)
+        return -1;
+    mlooper_pool_notify_stealable(pool, worker, !was_idle);
+    return 0;
+}
+
+int mlooper_pool_post_message_delay(mlooper_pool_handle pool, struct message *msg, unsigned long msec)
+{
+    // delayed messages are kept in msg_heap of the picked worker, not stealable
+    return mlooper_post_msgnode(mlooper_pool_pick_worker(pool, NULL), msg, msec, false);
+}
+
+int mlooper_pool_post_affinity_message(mlooper_pool_handle pool, struct message *msg, unsigned long key)
+{
+    return mlooper_post_msgnode(pool->workers[key % pool->worker_count], msg, 0, false);
+}
+
+int mlooper_pool_remove_message(mlooper_pool_handle pool, int what)
+{
+    unsigned int i;
+    for (i = 0; i < pool->worker_count; i++)
+        mlooper_remove_message(pool->workers[i], what);
+    return 0;
+}
+
 struct message *message_obtain(int what, int arg1, int arg2, void *data)
 {
     struct message *msg = OS_CALLOC(1, sizeof(struct message_node));
@@ -521,6 +1991,43 @@ struct message *message_obtain_buffer_obtain(int what, int arg1, int arg2, unsig
     return msg;
 }
 
+struct message *mlooper_message_obtain(mlooper_handle looper, int what, int arg1, int arg2, void *data)
+{
+    if (looper->node_pool.lock == NULL)
+        return message_obtain(what, arg1, arg2, data);
+    struct message_node *node = mlooper_node_pool_get(&looper->node_pool, 0);
+    if (node == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate message");
+        return NULL;
+    }
+    struct message *msg = (struct message *)node;
+    msg->what = what;
+    msg->arg1 = arg1;
+    msg->arg2 = arg2;
+    msg->data = data;
+    msg->state = MESSAGE_STATE_UNKNOWN;
+    return msg;
+}
+
+struct message *mlooper_message_obtain_buffer_obtain(mlooper_handle looper,
+                                                     int what, int arg1, int arg2, unsigned int size)
+{
+    if (looper->node_pool.lock == NULL)
+        return message_obtain_buffer_obtain(what, arg1, arg2, size);
+    struct message_node *node = mlooper_node_pool_get(&looper->node_pool, size);
+    if (node == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate message");
+        return NULL;
+    }
+    struct message *msg = (struct message *)node;
+    msg->what = what;
+    msg->arg1 = arg1;
+    msg->arg2 = arg2;
+    msg->data = size > 0 ? node->reserve : NULL;
+    msg->state = MESSAGE_STATE_UNKNOWN;
+    return msg;
+}
+
 void message_set_handle_cb(struct message *msg, message_cb on_handle)
 {
     msg->on_handle = on_handle;
@@ -541,3 +2048,10 @@ void message_set_timeout_cb(struct message *msg, message_cb on_timeout, unsigned
     msg->on_timeout = on_timeout;
     msg->timeout_ms = timeout_ms;
 }
+
+void message_set_result(struct message *msg, int result)
+{
+    struct message_node *node = (struct message_node *)msg;
+    if (node->waiter != NULL)
+        node->waiter->result = result;
+}
@@ -17,13 +17,28 @@
 #include <string.h>
 #include <stdbool.h>
 #include "osal/os_thread.h"
+#include "osal/os_time.h"
 #include "cutils/log_helper.h"
 #include "cutils/memory_helper.h"
 #include "cutils/list.h"
 #include "cutils/mqueue.h"
 
+#if !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define MQUEUE_HAVE_ATOMIC
+#endif
+
 #define LOG_TAG "mqueue"
 
+#define MQUEUE_PRIO_MAX      32
+#define MQUEUE_INVALID_SLOT  ((unsigned int)-1)
+#define MQUEUE_VARLEN_HDR    sizeof(unsigned int)
+
+struct mqueue_lane {
+    unsigned int head;      /**< First slot of the lane, MQUEUE_INVALID_SLOT if empty */
+    unsigned int tail;      /**< Last slot of the lane */
+};
+
 struct mqueue {
     char *head;  /**< Head pointer */
     char *read;  /**< Read pointer */
@@ -33,6 +48,7 @@ struct mqueue {
     unsigned int element_size; /**< Size of msg element */
     unsigned int element_count;/**< Number of total slots */
     unsigned int filled_count; /**< Number of filled slots */
+    bool on_node;              /**< Buffer is allocated by os_node_alloc() */
 
     os_cond can_read;
     os_cond can_write;
@@ -41,35 +57,84 @@ struct mqueue {
     bool is_set;            /**< Whether is queue-set */
     struct listnode list;   /**< List node for queue, list head for queue-set */
     mqset_handle parent_set; /**< Parent queue-set pointer */
+    struct listnode ready_list; /**< List node for ready queue, list head of ready queues for queue-set */
+    bool ready;             /**< Whether queue is in ready list of parent set */
+    unsigned int set_length;   /**< Number of member queues allowed, for queue-set */
+
+    bool send_reserved;     /**< Whether write slot is reserved, see mqueue_send_reserve() */
+    bool receive_reserved;  /**< Whether read slot is reserved, see mqueue_receive_peek() */
+
+    bool varlen;               /**< Whether is variable-length queue, see mqueue_create_varlen() */
+    unsigned int prio_count;   /**< Number of priority lanes, 0 if not priority queue */
+    struct mqueue_lane *lanes; /**< Lanes of priority queue, see mqueue_create_prio() */
+    unsigned int *slot_next;   /**< Next slot in the same lane or in free list */
+    unsigned int free_slot;    /**< Head of free slot list */
+    unsigned int lane_bitmap;  /**< Bit n is set if lane n isn't empty */
+
+    bool lockfree;          /**< Whether is lock-free queue, see mqueue_create_lockfree() */
+#if defined(MQUEUE_HAVE_ATOMIC)
+    atomic_uint *slot_seq;  /**< Sequence of each slot */
+    // cursors are CASed by senders and receivers respectively, pad them and
+    // the read-mostly waiter counts to separate cache lines. Padding instead
+    // of _Alignas as queue is allocated by OS_CALLOC without alignment
+    OS_CACHELINE_PAD(pad0, 0)
+    atomic_uint enqueue_pos;/**< Next position to write */
+    OS_CACHELINE_PAD(pad1, sizeof(atomic_uint))
+    atomic_uint dequeue_pos;/**< Next position to read */
+    OS_CACHELINE_PAD(pad2, sizeof(atomic_uint))
+    atomic_uint read_waiters;  /**< Number of receivers parking on can_read */
+    atomic_uint write_waiters; /**< Number of senders parking on can_write */
+#endif
 };
 
-mq_handle mqueue_create(unsigned int msg_size, unsigned int msg_count)
+// mqueue_sync_offset:
+//   Round @size up so sync primitives stored after it are aligned as malloc()
+static unsigned int mqueue_sync_offset(unsigned int size)
+{
+    unsigned int align = 2 * sizeof(void *);
+    return (size + align - 1) / align * align;
+}
+
+static mq_handle mqueue_create_internal(unsigned int msg_size, unsigned int msg_count, int node)
 {
-    struct mqueue *queue = OS_CALLOC(1, sizeof(struct mqueue));
+    // mutex and conds are embedded after the queue in a single allocation,
+    // saving the pointer chase to separately allocated primitives
+    unsigned int lock_offset = mqueue_sync_offset(sizeof(struct mqueue));
+    unsigned int read_offset = lock_offset + mqueue_sync_offset(os_mutex_storage_size());
+    unsigned int write_offset = read_offset + mqueue_sync_offset(os_cond_storage_size());
+    struct mqueue *queue = OS_CALLOC(1, write_offset + os_cond_storage_size());
     if (queue == NULL) {
         OS_LOGE(LOG_TAG, "Failed to allocate queue");
         return NULL;
     }
 
-    queue->lock = os_mutex_create();
+    queue->lock = os_mutex_init((char *)queue + lock_offset);
     if (queue->lock == NULL) {
         OS_LOGE(LOG_TAG, "Failed to create queue mutex");
         goto error;
     }
 
-    queue->can_read = os_cond_create();
+    queue->can_read = os_cond_init((char *)queue + read_offset);
     if (queue->can_read == NULL) {
         OS_LOGE(LOG_TAG, "Failed to create queue cond");
         goto error;
     }
 
-    queue->can_write = os_cond_create();
+    queue->can_write = os_cond_init((char *)queue + write_offset);
     if (queue->can_write == NULL) {
         OS_LOGE(LOG_TAG, "Failed to create queue cond");
         goto error;
     }
 
-    queue->head = OS_CALLOC(msg_count, msg_size);
+    if (node >= 0) {
+        queue->head = os_node_alloc(msg_count * msg_size, node);
+        if (queue->head != NULL)
+            queue->on_node = true;
+        else
+            OS_LOGW(LOG_TAG, "Failed to allocate queue buffer on node %d, fallback to normal buffer", node);
+    }
+    if (queue->head == NULL)
+        queue->head = OS_CALLOC(msg_count, msg_size);
     if (queue->head == NULL) {
         OS_LOGE(LOG_TAG, "Failed to allocate queue buffer");
         goto error;
@@ -83,7 +148,9 @@ mq_handle mqueue_create(unsigned int msg_size, unsigned int msg_count)
     queue->filled_count = 0;
     queue->parent_set = NULL;
     queue->is_set = false;
+    queue->ready = false;
     list_init(&queue->list);
+    list_init(&queue->ready_list);
 
     return queue;
 
@@ -91,15 +158,461 @@ error:
     if (queue->head != NULL)
         OS_FREE(queue->head);
     if (queue->can_write != NULL)
-        os_cond_destroy(queue->can_write);
+        os_cond_deinit(queue->can_write);
     if (queue->can_read != NULL)
-        os_cond_destroy(queue->can_read);
+        os_cond_deinit(queue->can_read);
     if (queue->lock != NULL)
-        os_mutex_destroy(queue->lock);
+        os_mutex_deinit(queue->lock);
     OS_FREE(queue);
     return NULL;
 }
 
+mq_handle mqueue_create(unsigned int msg_size, unsigned int msg_count)
+{
+    return mqueue_create_internal(msg_size, msg_count, -1);
+}
+
+mq_handle mqueue_create_on_node(unsigned int msg_size, unsigned int msg_count, int node)
+{
+    return mqueue_create_internal(msg_size, msg_count, node);
+}
+
+#if defined(MQUEUE_HAVE_ATOMIC)
+/*
+ * Lock-free queue is a bounded MPMC ring as described by Dmitry Vyukov:
+ * slot i is free for the sender that claims position pos if slot_seq[i] == pos,
+ * and is filled for the receiver that claims pos if slot_seq[i] == pos + 1.
+ * Senders and receivers claim positions with a CAS and never take @lock,
+ * which is only used to park a thread when queue is full or empty.
+ */
+// mqueue_lockfree_claim_range:
+//   Claim at most @max consecutive slots at @cursor, @lag is 0 for senders and
+//   1 for receivers. Store the first claimed position to @start and return the
+//   number of claimed slots, 0 if queue is full (senders) or empty (receivers).
+//   All slots are checked before the cursor moves, so a single CAS hands the
+//   whole range to us
+static unsigned int mqueue_lockfree_claim_range(mq_handle queue, atomic_uint *cursor,
+                                                unsigned int lag, unsigned int max,
+                                                unsigned int *start)
+{
+    unsigned int mask = queue->element_count - 1;
+    unsigned int pos = atomic_load_explicit(cursor, memory_order_relaxed);
+    unsigned int seq, n;
+    int diff = 0;
+
+    if (max == 0)
+        return 0;
+
+    while (1) {
+        for (n = 0; n < max; n++) {
+            seq = atomic_load_explicit(&queue->slot_seq[(pos + n) & mask], memory_order_acquire);
+            diff = (int)(seq - (pos + n + lag));
+            if (diff != 0)
+                break;
+        }
+        if (n > 0) {
+            if (atomic_compare_exchange_weak_explicit(cursor, &pos, pos + n,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *start = pos;
+                return n;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(cursor, memory_order_relaxed);
+        }
+    }
+}
+
+static char *mqueue_lockfree_claim(mq_handle queue, atomic_uint *cursor, unsigned int lag)
+{
+    unsigned int pos;
+    if (mqueue_lockfree_claim_range(queue, cursor, lag, 1, &pos) == 0)
+        return NULL;
+    return queue->head + (pos & (queue->element_count - 1)) * queue->element_size;
+}
+
+// mqueue_lockfree_publish:
+//   Hand a claimed slot over to the other side, @step is 1 after writing and
+//   element_count - 1 after reading
+static void mqueue_lockfree_publish(mq_handle queue, char *slot, unsigned int step)
+{
+    unsigned int index = (slot - queue->head) / queue->element_size;
+    unsigned int seq = atomic_load_explicit(&queue->slot_seq[index], memory_order_relaxed);
+    atomic_store_explicit(&queue->slot_seq[index], seq + step, memory_order_release);
+}
+
+// mqueue_lockfree_claimed:
+//   Check that @slot is claimed from @cursor and not published yet, @lag is
+//   0 for sender and 1 for receiver, same as mqueue_lockfree_claim()
+static bool mqueue_lockfree_claimed(mq_handle queue, char *slot, atomic_uint *cursor, unsigned int lag)
+{
+    unsigned int mask = queue->element_count - 1;
+    unsigned int index, seq;
+
+    if (slot < queue->head || slot >= queue->tail ||
+        (slot - queue->head) % queue->element_size != 0)
+        return false;
+    index = (slot - queue->head) / queue->element_size;
+    seq = atomic_load_explicit(&queue->slot_seq[index], memory_order_acquire) - lag;
+    // seq is the position slot is claimed at, which must be behind cursor
+    return (seq & mask) == index &&
+           (int)(atomic_load_explicit(cursor, memory_order_relaxed) - seq) > 0;
+}
+
+static int mqueue_lockfree_enqueue(mq_handle queue, char *msg)
+{
+    char *slot = mqueue_lockfree_claim(queue, &queue->enqueue_pos, 0);
+    if (slot == NULL)
+        return -1; // full
+    memcpy(slot, msg, queue->element_size);
+    mqueue_lockfree_publish(queue, slot, 1);
+    return 0;
+}
+
+static int mqueue_lockfree_dequeue(mq_handle queue, char *msg)
+{
+    char *slot = mqueue_lockfree_claim(queue, &queue->dequeue_pos, 1);
+    if (slot == NULL)
+        return -1; // empty
+    memcpy(msg, slot, queue->element_size);
+    mqueue_lockfree_publish(queue, slot, queue->element_count - 1);
+    return 0;
+}
+
+// mqueue_lockfree_*_batch:
+//   Move at most @count msgs without blocking, return number of moved msgs
+static unsigned int mqueue_lockfree_enqueue_batch(mq_handle queue, const char *msgs, unsigned int count)
+{
+    unsigned int mask = queue->element_count - 1;
+    unsigned int pos, first, n, i;
+
+    n = mqueue_lockfree_claim_range(queue, &queue->enqueue_pos, 0, count, &pos);
+    if (n == 0)
+        return 0;
+
+    first = queue->element_count - (pos & mask);
+    if (first > n)
+        first = n;
+    memcpy(queue->head + (pos & mask) * queue->element_size, msgs, first * queue->element_size);
+    memcpy(queue->head, msgs + first * queue->element_size, (n - first) * queue->element_size);
+
+    for (i = 0; i < n; i++)
+        atomic_store_explicit(&queue->slot_seq[(pos + i) & mask], pos + i + 1, memory_order_release);
+    return n;
+}
+
+static unsigned int mqueue_lockfree_dequeue_batch(mq_handle queue, char *msgs, unsigned int count)
+{
+    unsigned int mask = queue->element_count - 1;
+    unsigned int pos, first, n, i;
+
+    n = mqueue_lockfree_claim_range(queue, &queue->dequeue_pos, 1, count, &pos);
+    if (n == 0)
+        return 0;
+
+    first = queue->element_count - (pos & mask);
+    if (first > n)
+        first = n;
+    memcpy(msgs, queue->head + (pos & mask) * queue->element_size, first * queue->element_size);
+    memcpy(msgs + first * queue->element_size, queue->head, (n - first) * queue->element_size);
+
+    for (i = 0; i < n; i++)
+        atomic_store_explicit(&queue->slot_seq[(pos + i) & mask], pos + i + mask + 1, memory_order_release);
+    return n;
+}
+
+// mqueue_lockfree_*_op:
+//   Claim ops for mqueue_lockfree_wait(), @arg is a "char **" to store the slot
+static int mqueue_lockfree_reserve_op(mq_handle queue, char *arg)
+{
+    char **slot = (char **)arg;
+    *slot = mqueue_lockfree_claim(queue, &queue->enqueue_pos, 0);
+    return *slot != NULL ? 0 : -1;
+}
+
+static int mqueue_lockfree_peek_op(mq_handle queue, char *arg)
+{
+    char **slot = (char **)arg;
+    *slot = mqueue_lockfree_claim(queue, &queue->dequeue_pos, 1);
+    return *slot != NULL ? 0 : -1;
+}
+
+// mqueue_lockfree_wake:
+//   Wake up one thread (or all if @all) parking on @cond, only take @lock if
+//   there is a waiter.
+//   The fence pairs with the fence in mqueue_lockfree_wait(), either we see
+//   the waiter or the waiter sees the slot we just published
+static void mqueue_lockfree_wake(mq_handle queue, os_cond cond, atomic_uint *waiters, bool all)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiters, memory_order_relaxed) > 0) {
+        os_mutex_lock(queue->lock);
+        if (all)
+            os_cond_broadcast(cond);
+        else
+            os_cond_signal(cond);
+        os_mutex_unlock(queue->lock);
+    }
+}
+
+// mqueue_lockfree_wait:
+//   Slow path, retry @op and park on @cond until it succeeds or timeout
+static int mqueue_lockfree_wait(mq_handle queue, char *msg, unsigned long timeout_ms,
+                                int (*op)(mq_handle queue, char *msg),
+                                os_cond cond, atomic_uint *waiters)
+{
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+    int ret;
+
+    os_mutex_lock(queue->lock);
+    atomic_fetch_add(waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while ((ret = op(queue, msg)) != 0) {
+        if (os_cond_timedwait_until(cond, queue->lock, deadline) != 0) {
+            ret = op(queue, msg);
+            break;
+        }
+    }
+    atomic_fetch_sub(waiters, 1);
+    os_mutex_unlock(queue->lock);
+    return ret;
+}
+
+static int mqueue_lockfree_send(mq_handle queue, char *msg, unsigned long timeout_ms)
+{
+    int ret = mqueue_lockfree_enqueue(queue, msg);
+    if (ret != 0 && timeout_ms > 0)
+        ret = mqueue_lockfree_wait(queue, msg, timeout_ms, mqueue_lockfree_enqueue,
+                                   queue->can_write, &queue->write_waiters);
+    if (ret == 0)
+        mqueue_lockfree_wake(queue, queue->can_read, &queue->read_waiters, false);
+    else
+        OS_LOGE(LOG_TAG, "Failed to send msg to full queue");
+    return ret;
+}
+
+static int mqueue_lockfree_receive(mq_handle queue, char *msg, unsigned long timeout_ms)
+{
+    int ret = mqueue_lockfree_dequeue(queue, msg);
+    if (ret != 0 && timeout_ms > 0)
+        ret = mqueue_lockfree_wait(queue, msg, timeout_ms, mqueue_lockfree_dequeue,
+                                   queue->can_read, &queue->read_waiters);
+    if (ret == 0)
+        mqueue_lockfree_wake(queue, queue->can_write, &queue->write_waiters, false);
+    return ret;
+}
+
+static char *mqueue_lockfree_send_reserve(mq_handle queue, unsigned long timeout_ms)
+{
+    char *slot = NULL;
+    if (mqueue_lockfree_reserve_op(queue, (char *)&slot) != 0 && timeout_ms > 0)
+        mqueue_lockfree_wait(queue, (char *)&slot, timeout_ms, mqueue_lockfree_reserve_op,
+                             queue->can_write, &queue->write_waiters);
+    if (slot == NULL)
+        OS_LOGE(LOG_TAG, "Failed to reserve slot from full queue");
+    return slot;
+}
+
+static char *mqueue_lockfree_receive_peek(mq_handle queue, unsigned long timeout_ms)
+{
+    char *slot = NULL;
+    if (mqueue_lockfree_peek_op(queue, (char *)&slot) != 0 && timeout_ms > 0)
+        mqueue_lockfree_wait(queue, (char *)&slot, timeout_ms, mqueue_lockfree_peek_op,
+                             queue->can_read, &queue->read_waiters);
+    return slot;
+}
+
+static int mqueue_lockfree_send_batch(mq_handle queue, const char *msgs, unsigned int count,
+                                      unsigned long timeout_ms)
+{
+    unsigned int n = mqueue_lockfree_enqueue_batch(queue, msgs, count);
+    if (n == 0 && timeout_ms > 0 &&
+        mqueue_lockfree_wait(queue, (char *)msgs, timeout_ms, mqueue_lockfree_enqueue,
+                             queue->can_write, &queue->write_waiters) == 0) {
+        n = 1 + mqueue_lockfree_enqueue_batch(queue, msgs + queue->element_size, count - 1);
+    }
+    if (n == 0) {
+        OS_LOGE(LOG_TAG, "Failed to send msg to full queue");
+        return -1;
+    }
+    mqueue_lockfree_wake(queue, queue->can_read, &queue->read_waiters, n > 1);
+    return n;
+}
+
+static int mqueue_lockfree_receive_batch(mq_handle queue, char *msgs, unsigned int count,
+                                         unsigned long timeout_ms)
+{
+    unsigned int n = mqueue_lockfree_dequeue_batch(queue, msgs, count);
+    if (n == 0 && timeout_ms > 0 &&
+        mqueue_lockfree_wait(queue, msgs, timeout_ms, mqueue_lockfree_dequeue,
+                             queue->can_read, &queue->read_waiters) == 0) {
+        n = 1 + mqueue_lockfree_dequeue_batch(queue, msgs + queue->element_size, count - 1);
+    }
+    if (n == 0)
+        return -1;
+    mqueue_lockfree_wake(queue, queue->can_write, &queue->write_waiters, n > 1);
+    return n;
+}
+
+static void mqueue_lockfree_reset(mq_handle queue)
+{
+    unsigned int i;
+    for (i = 0; i < queue->element_count; i++)
+        atomic_init(&queue->slot_seq[i], i);
+    atomic_store(&queue->enqueue_pos, 0);
+    atomic_store(&queue->dequeue_pos, 0);
+}
+#endif
+
+mq_handle mqueue_create_lockfree(unsigned int msg_size, unsigned int msg_count)
+{
+#if defined(MQUEUE_HAVE_ATOMIC)
+    unsigned int count = 1;
+    while (count < msg_count)
+        count <<= 1;
+
+    struct mqueue *queue = mqueue_create(msg_size, count);
+    if (queue == NULL)
+        return NULL;
+
+    queue->slot_seq = OS_MALLOC(count * sizeof(atomic_uint));
+    if (queue->slot_seq == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate queue slots");
+        mqueue_destroy(queue);
+        return NULL;
+    }
+    mqueue_lockfree_reset(queue);
+    atomic_init(&queue->read_waiters, 0);
+    atomic_init(&queue->write_waiters, 0);
+    queue->lockfree = true;
+    return queue;
+#else
+    OS_LOGW(LOG_TAG, "Atomic not supported, create locked queue");
+    return mqueue_create(msg_size, msg_count);
+#endif
+}
+
+static void mqueue_prio_reset(mq_handle queue)
+{
+    unsigned int i;
+    for (i = 0; i < queue->element_count; i++)
+        queue->slot_next[i] = i + 1 < queue->element_count ? i + 1 : MQUEUE_INVALID_SLOT;
+    for (i = 0; i < queue->prio_count; i++) {
+        queue->lanes[i].head = MQUEUE_INVALID_SLOT;
+        queue->lanes[i].tail = MQUEUE_INVALID_SLOT;
+    }
+    queue->free_slot = queue->element_count > 0 ? 0 : MQUEUE_INVALID_SLOT;
+    queue->lane_bitmap = 0;
+}
+
+mq_handle mqueue_create_prio(unsigned int msg_size, unsigned int msg_count, unsigned int prio_count)
+{
+    if (prio_count == 0 || prio_count > MQUEUE_PRIO_MAX) {
+        OS_LOGE(LOG_TAG, "Invalid priority count: %u", prio_count);
+        return NULL;
+    }
+
+    struct mqueue *queue = mqueue_create(msg_size, msg_count);
+    if (queue == NULL)
+        return NULL;
+
+    queue->slot_next = OS_MALLOC(msg_count * sizeof(unsigned int));
+    queue->lanes = OS_MALLOC(prio_count * sizeof(struct mqueue_lane));
+    if (queue->slot_next == NULL || queue->lanes == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate queue lanes");
+        mqueue_destroy(queue);
+        return NULL;
+    }
+    queue->prio_count = prio_count;
+    mqueue_prio_reset(queue);
+    return queue;
+}
+
+// mqueue_prio_push / mqueue_prio_pop:
+//   Slots are shared by all lanes, each lane is a FIFO linked by slot_next,
+//   and receivers find the highest non-empty lane from lane_bitmap in O(1)
+static void mqueue_prio_push(mq_handle queue, const char *msg, unsigned int prio)
+{
+    struct mqueue_lane *lane = &queue->lanes[prio];
+    unsigned int slot = queue->free_slot;
+
+    queue->free_slot = queue->slot_next[slot];
+    memcpy(queue->head + slot * queue->element_size, msg, queue->element_size);
+    queue->slot_next[slot] = MQUEUE_INVALID_SLOT;
+
+    if (lane->tail == MQUEUE_INVALID_SLOT)
+        lane->head = slot;
+    else
+        queue->slot_next[lane->tail] = slot;
+    lane->tail = slot;
+    queue->lane_bitmap |= 1u << prio;
+    queue->filled_count++;
+}
+
+static unsigned int mqueue_prio_highest(unsigned int bitmap)
+{
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(bitmap);
+#else
+    unsigned int prio = MQUEUE_PRIO_MAX - 1;
+    while ((bitmap & (1u << prio)) == 0)
+        prio--;
+    return prio;
+#endif
+}
+
+static void mqueue_prio_pop(mq_handle queue, char *msg)
+{
+    unsigned int prio = mqueue_prio_highest(queue->lane_bitmap);
+    struct mqueue_lane *lane = &queue->lanes[prio];
+    unsigned int slot = lane->head;
+
+    memcpy(msg, queue->head + slot * queue->element_size, queue->element_size);
+    lane->head = queue->slot_next[slot];
+    if (lane->head == MQUEUE_INVALID_SLOT) {
+        lane->tail = MQUEUE_INVALID_SLOT;
+        queue->lane_bitmap &= ~(1u << prio);
+    }
+
+    queue->slot_next[slot] = queue->free_slot;
+    queue->free_slot = slot;
+    queue->filled_count--;
+}
+
+mq_handle mqueue_create_varlen(unsigned int capacity)
+{
+    // byte ring, element_count/filled_count are counted in bytes
+    struct mqueue *queue = mqueue_create(1, capacity);
+    if (queue == NULL)
+        return NULL;
+    queue->varlen = true;
+    return queue;
+}
+
+// mqueue_update_ready:
+//   Link a set member to ready list of its set when it becomes non-empty and
+//   unlink it when it becomes empty, so set lock is only taken on these
+//   transitions. Called with @queue->lock held
+static void mqueue_update_ready(mq_handle queue)
+{
+    mqset_handle set = queue->parent_set;
+    bool ready = queue->filled_count > 0;
+
+    if (set == NULL || queue->ready == ready)
+        return;
+
+    os_mutex_lock(set->lock);
+    queue->ready = ready;
+    if (ready) {
+        list_add_tail(&set->ready_list, &queue->ready_list);
+        os_cond_signal(set->can_read);
+    } else {
+        list_remove(&queue->ready_list);
+    }
+    os_mutex_unlock(set->lock);
+}
+
 int mqueue_destroy(mq_handle queue)
 {
     if (mqueue_count_filled(queue) > 0) {
@@ -110,77 +623,175 @@ int mqueue_destroy(mq_handle queue)
     if (queue->parent_set != NULL) {
         os_mutex_lock(queue->parent_set->lock);
         list_remove(&queue->list);
+        if (queue->ready)
+            list_remove(&queue->ready_list);
         os_mutex_unlock(queue->parent_set->lock);
     }
 
-    OS_FREE(queue->head);
-    os_cond_destroy(queue->can_write);
-    os_cond_destroy(queue->can_read);
-    os_mutex_destroy(queue->lock);
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->slot_seq != NULL)
+        OS_FREE(queue->slot_seq);
+#endif
+    if (queue->slot_next != NULL)
+        OS_FREE(queue->slot_next);
+    if (queue->lanes != NULL)
+        OS_FREE(queue->lanes);
+    if (queue->on_node)
+        os_node_free(queue->head, queue->element_count * queue->element_size);
+    else
+        OS_FREE(queue->head);
+    os_cond_deinit(queue->can_write);
+    os_cond_deinit(queue->can_read);
+    os_mutex_deinit(queue->lock);
     OS_FREE(queue);
     return 0;
 }
 
 int mqueue_reset(mq_handle queue)
 {
-    os_mutex_lock(queue->lock);
-
-    if (queue->parent_set != NULL && mqueue_count_filled(queue) > 0) {
-        OS_LOGE(LOG_TAG, "Can't reset queue that parent set isn't empty");
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree) {
+        os_mutex_lock(queue->lock);
+        mqueue_lockfree_reset(queue);
+        os_cond_broadcast(queue->can_write);
         os_mutex_unlock(queue->lock);
-        return -1;
+        return 0;
     }
+#endif
+
+    os_mutex_lock(queue->lock);
 
     queue->read = queue->head;
     queue->write = queue->head;
     queue->filled_count = 0;
+    queue->send_reserved = false;
+    queue->receive_reserved = false;
+    if (queue->prio_count > 0)
+        mqueue_prio_reset(queue);
+    mqueue_update_ready(queue);
     os_cond_signal(queue->can_write);
 
     os_mutex_unlock(queue->lock);
     return 0;
 }
 
-static void mqueue_copy_msg(mq_handle queue, char *msg)
+static bool mqueue_can_write(mq_handle queue)
+{
+    return !queue->send_reserved && mqueue_count_available(queue) > 0;
+}
+
+static bool mqueue_can_read(mq_handle queue)
+{
+    return !queue->receive_reserved && mqueue_count_filled(queue) > 0;
+}
+
+// mqueue_wait:
+//   Wait on @cond until @ready or @timeout_ms elapses, spurious wakeups and
+//   losing the race to other threads don't shorten the wait.
+//   Called with @queue->lock held
+static void mqueue_wait(mq_handle queue, os_cond cond, bool (*ready)(mq_handle queue),
+                        unsigned long timeout_ms)
+{
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+    while (!ready(queue)) {
+        if (os_cond_timedwait_until(cond, queue->lock, deadline) != 0)
+            break;
+    }
+}
+
+static void mqueue_advance_write(mq_handle queue)
 {
-    memcpy(queue->write, msg, queue->element_size);
     queue->filled_count++;
     queue->write += queue->element_size;
     if (queue->write >= queue->tail)
         queue->write = queue->head;
 }
 
+static void mqueue_advance_read(mq_handle queue)
+{
+    queue->filled_count--;
+    queue->read += queue->element_size;
+    if (queue->read >= queue->tail)
+        queue->read = queue->head;
+}
+
+// mqueue_write_batch / mqueue_read_batch:
+//   Copy @count msgs in at most two memcpy, caller makes sure there is room
+static void mqueue_write_batch(mq_handle queue, const char *msgs, unsigned int count)
+{
+    unsigned int first = (queue->tail - queue->write) / queue->element_size;
+    if (first > count)
+        first = count;
+    memcpy(queue->write, msgs, first * queue->element_size);
+    memcpy(queue->head, msgs + first * queue->element_size, (count - first) * queue->element_size);
+
+    queue->filled_count += count;
+    queue->write += count * queue->element_size;
+    if (queue->write >= queue->tail)
+        queue->write -= queue->tail - queue->head;
+}
+
+static void mqueue_read_batch(mq_handle queue, char *msgs, unsigned int count)
+{
+    unsigned int first = (queue->tail - queue->read) / queue->element_size;
+    if (first > count)
+        first = count;
+    memcpy(msgs, queue->read, first * queue->element_size);
+    memcpy(msgs + first * queue->element_size, queue->head, (count - first) * queue->element_size);
+
+    queue->filled_count -= count;
+    queue->read += count * queue->element_size;
+    if (queue->read >= queue->tail)
+        queue->read -= queue->tail - queue->head;
+}
+
+static void mqueue_copy_msg(mq_handle queue, char *msg)
+{
+    memcpy(queue->write, msg, queue->element_size);
+    mqueue_advance_write(queue);
+}
+
 int mqueue_send(mq_handle queue, char *msg, unsigned long timeout_ms)
+{
+    return mqueue_send_prio(queue, msg, 0, timeout_ms);
+}
+
+int mqueue_send_prio(mq_handle queue, char *msg, unsigned int prio, unsigned long timeout_ms)
 {
     int ret = -1;
 
+    // lock-free queue has no lanes, so prio must be 0 there as well
+    if (prio > 0 && prio >= queue->prio_count) {
+        OS_LOGE(LOG_TAG, "Invalid msg priority: %u", prio);
+        return -1;
+    }
+
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree)
+        return mqueue_lockfree_send(queue, msg, timeout_ms);
+#endif
+
+    if (queue->varlen) {
+        OS_LOGE(LOG_TAG, "Can't send fixed-size msg to variable-length queue");
+        return -1;
+    }
+
     os_mutex_lock(queue->lock);
 
-    if (mqueue_count_available(queue) == 0) {
+    if (!mqueue_can_write(queue)) {
         if (timeout_ms == 0)
             goto write_done;
         else
-            os_cond_timedwait(queue->can_write, queue->lock, timeout_ms*1000);
+            mqueue_wait(queue, queue->can_write, mqueue_can_write, timeout_ms);
     }
 
-    if (mqueue_count_available(queue) > 0) {
-        ret = 0;
-
-        if (queue->parent_set) {
-            mqset_handle set = queue->parent_set;
-
-            os_mutex_lock(set->lock);
-            if (mqueue_count_available(set) > 0) {
-                mqueue_copy_msg(queue, msg);
-                mqueue_copy_msg(set, (char *)&queue);
-                os_cond_signal(set->can_read);
-            } else {
-                OS_LOGE(LOG_TAG, "Failed to send msg to queue that parent set is full");
-                ret = -1;
-            }
-            os_mutex_unlock(set->lock);
-        } else {
+    if (mqueue_can_write(queue)) {
+        if (queue->prio_count > 0)
+            mqueue_prio_push(queue, msg, prio);
+        else
             mqueue_copy_msg(queue, msg);
-        }
+        mqueue_update_ready(queue);
+        ret = 0;
     }
 
 write_done:
@@ -197,21 +808,33 @@ int mqueue_receive(mq_handle queue, char *msg, unsigned long timeout_ms)
 {
     int ret = -1;
 
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree)
+        return mqueue_lockfree_receive(queue, msg, timeout_ms);
+#endif
+
+    if (queue->varlen) {
+        OS_LOGE(LOG_TAG, "Can't receive fixed-size msg from variable-length queue");
+        return -1;
+    }
+
     os_mutex_lock(queue->lock);
 
-    if (mqueue_count_filled(queue) == 0) {
+    if (!mqueue_can_read(queue)) {
         if (timeout_ms == 0)
             goto read_done;
         else
-            os_cond_timedwait(queue->can_read, queue->lock, timeout_ms*1000);
+            mqueue_wait(queue, queue->can_read, mqueue_can_read, timeout_ms);
     }
 
-    if (mqueue_count_filled(queue) > 0) {
-        memcpy(msg, queue->read, queue->element_size);
-        queue->filled_count--;
-        queue->read += queue->element_size;
-        if (queue->read >= queue->tail)
-            queue->read = queue->head;
+    if (mqueue_can_read(queue)) {
+        if (queue->prio_count > 0) {
+            mqueue_prio_pop(queue, msg);
+        } else {
+            memcpy(msg, queue->read, queue->element_size);
+            mqueue_advance_read(queue);
+        }
+        mqueue_update_ready(queue);
         ret = 0;
     }
 
@@ -223,40 +846,374 @@ read_done:
     return ret;
 }
 
+int mqueue_send_batch(mq_handle queue, const char *msgs, unsigned int count, unsigned long timeout_ms)
+{
+    unsigned int n = 0;
+
+    if (count == 0)
+        return -1;
+
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree)
+        return mqueue_lockfree_send_batch(queue, msgs, count, timeout_ms);
+#endif
+
+    if (queue->prio_count > 0 || queue->varlen) {
+        OS_LOGE(LOG_TAG, "Priority or variable-length queue doesn't support batch");
+        return -1;
+    }
+
+    os_mutex_lock(queue->lock);
+
+    if (!mqueue_can_write(queue)) {
+        if (timeout_ms == 0)
+            goto write_done;
+        else
+            mqueue_wait(queue, queue->can_write, mqueue_can_write, timeout_ms);
+    }
+
+    if (mqueue_can_write(queue)) {
+        n = mqueue_count_available(queue);
+        if (n > count)
+            n = count;
+
+        mqueue_write_batch(queue, msgs, n);
+        mqueue_update_ready(queue);
+    }
+
+write_done:
+    if (n > 0)
+        os_cond_broadcast(queue->can_read);
+    else
+        OS_LOGE(LOG_TAG, "Failed to send msg to full queue");
+
+    os_mutex_unlock(queue->lock);
+    return n > 0 ? (int)n : -1;
+}
+
+int mqueue_receive_batch(mq_handle queue, char *msgs, unsigned int count, unsigned long timeout_ms)
+{
+    unsigned int n = 0;
+
+    if (count == 0)
+        return -1;
+
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree)
+        return mqueue_lockfree_receive_batch(queue, msgs, count, timeout_ms);
+#endif
+
+    if (queue->prio_count > 0 || queue->varlen) {
+        OS_LOGE(LOG_TAG, "Priority or variable-length queue doesn't support batch");
+        return -1;
+    }
+
+    os_mutex_lock(queue->lock);
+
+    if (!mqueue_can_read(queue)) {
+        if (timeout_ms == 0)
+            goto read_done;
+        else
+            mqueue_wait(queue, queue->can_read, mqueue_can_read, timeout_ms);
+    }
+
+    if (mqueue_can_read(queue)) {
+        n = mqueue_count_filled(queue);
+        if (n > count)
+            n = count;
+        mqueue_read_batch(queue, msgs, n);
+        mqueue_update_ready(queue);
+    }
+
+read_done:
+    if (n > 0)
+        os_cond_broadcast(queue->can_write);
+
+    os_mutex_unlock(queue->lock);
+    return n > 0 ? (int)n : -1;
+}
+
+// mqueue_varlen_peek_len:
+//   Return length of the oldest record without consuming it, the length prefix
+//   may wrap around the end of ring
+static unsigned int mqueue_varlen_peek_len(mq_handle queue)
+{
+    unsigned int len, i;
+    char *dst = (char *)&len, *src = queue->read;
+
+    for (i = 0; i < MQUEUE_VARLEN_HDR; i++) {
+        dst[i] = *src++;
+        if (src >= queue->tail)
+            src = queue->head;
+    }
+    return len;
+}
+
+int mqueue_send_varlen(mq_handle queue, const char *msg, unsigned int len, unsigned long timeout_ms)
+{
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+    unsigned int record;
+    int ret = -1;
+
+    if (!queue->varlen) {
+        OS_LOGE(LOG_TAG, "Can't send variable-length msg to fixed-size queue");
+        return -1;
+    }
+
+    // check before adding header, so a huge @len can't wrap record around
+    if (queue->element_count < MQUEUE_VARLEN_HDR || len > queue->element_count - MQUEUE_VARLEN_HDR) {
+        OS_LOGE(LOG_TAG, "Msg is too large: len=[%u], capacity=[%u]", len, queue->element_count);
+        return -1;
+    }
+    record = MQUEUE_VARLEN_HDR + len;
+
+    os_mutex_lock(queue->lock);
+
+    while (mqueue_count_available(queue) < record) {
+        if (timeout_ms == 0 ||
+            os_cond_timedwait_until(queue->can_write, queue->lock, deadline) != 0)
+            break;
+    }
+
+    if (mqueue_count_available(queue) >= record) {
+        mqueue_write_batch(queue, (char *)&len, MQUEUE_VARLEN_HDR);
+        mqueue_write_batch(queue, msg, len);
+        mqueue_update_ready(queue);
+        os_cond_signal(queue->can_read);
+        ret = 0;
+    } else {
+        OS_LOGE(LOG_TAG, "Failed to send msg to full queue");
+    }
+
+    os_mutex_unlock(queue->lock);
+    return ret;
+}
+
+int mqueue_receive_varlen(mq_handle queue, char *buf, unsigned int size, unsigned long timeout_ms)
+{
+    unsigned int len;
+    int ret = -1;
+
+    if (!queue->varlen) {
+        OS_LOGE(LOG_TAG, "Can't receive variable-length msg from fixed-size queue");
+        return -1;
+    }
+
+    os_mutex_lock(queue->lock);
+
+    if (!mqueue_can_read(queue)) {
+        if (timeout_ms == 0)
+            goto read_done;
+        else
+            mqueue_wait(queue, queue->can_read, mqueue_can_read, timeout_ms);
+    }
+
+    if (mqueue_can_read(queue)) {
+        len = mqueue_varlen_peek_len(queue);
+        if (len > size) {
+            OS_LOGE(LOG_TAG, "Buffer is too small: len=[%u], size=[%u]", len, size);
+            goto read_done;
+        }
+        mqueue_read_batch(queue, (char *)&len, MQUEUE_VARLEN_HDR);
+        mqueue_read_batch(queue, buf, len);
+        mqueue_update_ready(queue);
+        // freed space may satisfy more than one sender waiting for different sizes
+        os_cond_broadcast(queue->can_write);
+        ret = (int)len;
+    }
+
+read_done:
+    os_mutex_unlock(queue->lock);
+    return ret;
+}
+
+char *mqueue_send_reserve(mq_handle queue, unsigned long timeout_ms)
+{
+    char *slot = NULL;
+
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree)
+        return mqueue_lockfree_send_reserve(queue, timeout_ms);
+#endif
+
+    if (queue->prio_count > 0 || queue->varlen) {
+        OS_LOGE(LOG_TAG, "Priority or variable-length queue doesn't support zero-copy");
+        return NULL;
+    }
+
+    os_mutex_lock(queue->lock);
+
+    if (!mqueue_can_write(queue)) {
+        if (timeout_ms == 0)
+            goto reserve_done;
+        else
+            mqueue_wait(queue, queue->can_write, mqueue_can_write, timeout_ms);
+    }
+
+    if (mqueue_can_write(queue)) {
+        queue->send_reserved = true;
+        slot = queue->write;
+    }
+
+reserve_done:
+    if (slot == NULL)
+        OS_LOGE(LOG_TAG, "Failed to reserve slot from full queue");
+
+    os_mutex_unlock(queue->lock);
+    return slot;
+}
+
+int mqueue_send_commit(mq_handle queue, char *slot)
+{
+    int ret = -1;
+
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree) {
+        if (!mqueue_lockfree_claimed(queue, slot, &queue->enqueue_pos, 0)) {
+            OS_LOGE(LOG_TAG, "Can't commit slot that isn't reserved");
+            return -1;
+        }
+        mqueue_lockfree_publish(queue, slot, 1);
+        mqueue_lockfree_wake(queue, queue->can_read, &queue->read_waiters, false);
+        return 0;
+    }
+#endif
+
+    os_mutex_lock(queue->lock);
+
+    if (!queue->send_reserved || slot != queue->write) {
+        OS_LOGE(LOG_TAG, "Can't commit slot that isn't reserved");
+        os_mutex_unlock(queue->lock);
+        return -1;
+    }
+
+    queue->send_reserved = false;
+    mqueue_advance_write(queue);
+    mqueue_update_ready(queue);
+    ret = 0;
+
+    os_cond_signal(queue->can_read);
+    // wake up the sender that waits for reservation, if any
+    os_cond_signal(queue->can_write);
+
+    os_mutex_unlock(queue->lock);
+    return ret;
+}
+
+char *mqueue_receive_peek(mq_handle queue, unsigned long timeout_ms)
+{
+    char *slot = NULL;
+
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree)
+        return mqueue_lockfree_receive_peek(queue, timeout_ms);
+#endif
+
+    if (queue->prio_count > 0 || queue->varlen) {
+        OS_LOGE(LOG_TAG, "Priority or variable-length queue doesn't support zero-copy");
+        return NULL;
+    }
+
+    os_mutex_lock(queue->lock);
+
+    if (!mqueue_can_read(queue)) {
+        if (timeout_ms == 0)
+            goto peek_done;
+        else
+            mqueue_wait(queue, queue->can_read, mqueue_can_read, timeout_ms);
+    }
+
+    if (mqueue_can_read(queue)) {
+        queue->receive_reserved = true;
+        slot = queue->read;
+    }
+
+peek_done:
+    os_mutex_unlock(queue->lock);
+    return slot;
+}
+
+int mqueue_receive_release(mq_handle queue, char *slot)
+{
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree) {
+        if (!mqueue_lockfree_claimed(queue, slot, &queue->dequeue_pos, 1)) {
+            OS_LOGE(LOG_TAG, "Can't release slot that isn't peeked");
+            return -1;
+        }
+        mqueue_lockfree_publish(queue, slot, queue->element_count - 1);
+        mqueue_lockfree_wake(queue, queue->can_write, &queue->write_waiters, false);
+        return 0;
+    }
+#endif
+
+    os_mutex_lock(queue->lock);
+
+    if (!queue->receive_reserved || slot != queue->read) {
+        OS_LOGE(LOG_TAG, "Can't release slot that isn't peeked");
+        os_mutex_unlock(queue->lock);
+        return -1;
+    }
+
+    queue->receive_reserved = false;
+    mqueue_advance_read(queue);
+    mqueue_update_ready(queue);
+    os_cond_signal(queue->can_write);
+    // wake up the receiver that waits for reservation, if any
+    os_cond_signal(queue->can_read);
+
+    os_mutex_unlock(queue->lock);
+    return 0;
+}
+
 unsigned int mqueue_count_available(mq_handle queue)
 {
-    return queue->element_count - queue->filled_count;
+    return queue->element_count - mqueue_count_filled(queue);
 }
 
 unsigned int mqueue_count_filled(mq_handle queue)
 {
+#if defined(MQUEUE_HAVE_ATOMIC)
+    if (queue->lockfree) {
+        // snapshot, may be stale when there are concurrent senders/receivers
+        unsigned int dequeue = atomic_load(&queue->dequeue_pos);
+        unsigned int enqueue = atomic_load(&queue->enqueue_pos);
+        unsigned int filled = enqueue - dequeue;
+        return filled > queue->element_count ? 0 : filled;
+    }
+#endif
     return queue->filled_count;
 }
 
 mqset_handle mqueueset_create(unsigned int msg_count)
 {
-    struct mqueue *queue = mqueue_create(sizeof(mq_handle), msg_count);
+    // set only links ready queues and doesn't store msgs, a member takes at
+    // most one entry of the ready list, so @msg_count limits number of members
+    struct mqueue *queue = mqueue_create(sizeof(mq_handle), 1);
     if (queue == NULL) {
         OS_LOGE(LOG_TAG, "Failed to allocate queue set");
         return NULL;
     }
 
     queue->is_set = true;
+    queue->set_length = msg_count;
     return queue;
 }
 
 int mqueueset_destroy(mqset_handle set)
 {
     struct mqueue *queue = NULL;
-    struct listnode *item, *tmp;
-
-    list_for_each_safe(item, tmp, &set->list) {
-        queue = listnode_to_item(item, struct mqueue, list);
-        list_remove(&queue->list);
 
-        os_mutex_lock(queue->lock);
-        queue->parent_set = NULL;
-        os_mutex_unlock(queue->lock);
+    // queue lock is taken before set lock, so pick a member with set lock
+    // and remove it with mqueueset_remove_queue() after releasing set lock
+    while (1) {
+        os_mutex_lock(set->lock);
+        queue = list_empty(&set->list) ? NULL :
+                listnode_to_item(list_head(&set->list), struct mqueue, list);
+        os_mutex_unlock(set->lock);
+        if (queue == NULL)
+            break;
+        mqueueset_remove_queue(set, queue);
     }
 
     return mqueue_destroy(set);
@@ -264,6 +1221,9 @@ int mqueueset_destroy(mqset_handle set)
 
 int mqueueset_add_queue(mqset_handle set, mq_handle queue)
 {
+    struct listnode *item;
+    unsigned int count = 0;
+
     if (queue->parent_set != NULL) {
         OS_LOGE(LOG_TAG, "Can't add queue to more than one set");
         return -1;
@@ -274,20 +1234,30 @@ int mqueueset_add_queue(mqset_handle set, mq_handle queue)
         return -1;
     }
 
+    if (queue->lockfree) {
+        OS_LOGE(LOG_TAG, "Can't add lock-free queue to a set");
+        return -1;
+    }
+
     os_mutex_lock(queue->lock);
+    os_mutex_lock(set->lock);
 
-    if (mqueue_count_filled(queue) > 0) {
-        OS_LOGE(LOG_TAG, "Can't add queue that isn't empty");
+    list_for_each(item, &set->list)
+        count++;
+    if (count >= set->set_length) {
+        OS_LOGE(LOG_TAG, "Number of queues exceeds length of the set");
+        os_mutex_unlock(set->lock);
         os_mutex_unlock(queue->lock);
         return -1;
     }
 
     queue->parent_set = set;
-
-    os_mutex_lock(set->lock);
     list_add_tail(&set->list, &queue->list);
     os_mutex_unlock(set->lock);
 
+    // queue that isn't empty is ready at once
+    mqueue_update_ready(queue);
+
     os_mutex_unlock(queue->lock);
     return 0;
 }
@@ -301,26 +1271,57 @@ int mqueueset_remove_queue(mqset_handle set, mq_handle queue)
 
     os_mutex_lock(queue->lock);
 
-    if (mqueue_count_filled(queue) > 0) {
-        OS_LOGE(LOG_TAG, "Can't remove queue that isn't empty");
-        os_mutex_unlock(queue->lock);
-        return -1;
-    }
-
-    queue->parent_set = NULL;
-
     os_mutex_lock(set->lock);
     list_remove(&queue->list);
+    if (queue->ready) {
+        list_remove(&queue->ready_list);
+        queue->ready = false;
+    }
     os_mutex_unlock(set->lock);
 
+    queue->parent_set = NULL;
+
     os_mutex_unlock(queue->lock);
 
     return 0;
 }
 
+static bool mqueueset_has_ready(mqset_handle set)
+{
+    return !list_empty(&set->ready_list);
+}
+
+int mqueueset_select_queues(mqset_handle set, mq_handle *queues, unsigned int count,
+                            unsigned long timeout_ms)
+{
+    struct listnode *item;
+    unsigned int n = 0;
+
+    if (count == 0)
+        return -1;
+
+    os_mutex_lock(set->lock);
+
+    if (!mqueueset_has_ready(set) && timeout_ms > 0)
+        mqueue_wait(set, set->can_read, mqueueset_has_ready, timeout_ms);
+
+    // rotate selected queues to the tail, so busy queues don't starve others
+    while (n < count && mqueueset_has_ready(set)) {
+        item = list_head(&set->ready_list);
+        if (n > 0 && queues[0] == listnode_to_item(item, struct mqueue, ready_list))
+            break;
+        queues[n++] = listnode_to_item(item, struct mqueue, ready_list);
+        list_remove(item);
+        list_add_tail(&set->ready_list, item);
+    }
+
+    os_mutex_unlock(set->lock);
+    return n > 0 ? (int)n : -1;
+}
+
 mq_handle mqueueset_select_queue(mqset_handle set, unsigned long timeout_ms)
 {
     mq_handle queue = NULL;
-    (void) mqueue_receive(set, (char *)&queue, timeout_ms);
+    (void) mqueueset_select_queues(set, &queue, 1, timeout_ms);
     return queue;
 }
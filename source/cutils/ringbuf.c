@@ -27,7 +27,9 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
 #include "osal/os_thread.h"
+#include "osal/os_time.h"
 #include "cutils/memory_helper.h"
 #include "cutils/log_helper.h"
 #include "cutils/ringbuf.h"
@@ -36,34 +38,83 @@
 
 struct ringbuf {
     char *p_o;                   /**< Original pointer */
-    char *volatile p_r;          /**< Read pointer */
-    char *volatile p_w;          /**< Write pointer */
-    int  fill_cnt;               /**< Number of filled slots */
-    int  threshold_cnt;          /**< Number of threshold slots */
     int  size;                   /**< Buffer size */
+    bool mirrored;               /**< Buffer is mapped twice back-to-back, never wraps around */
+    bool on_node;                /**< Buffer is allocated by os_node_alloc() */
     os_cond can_read;
     os_cond can_write;
     os_mutex lock;
+    int  fill_cnt;               /**< Number of filled slots */
+    bool unblock_reader_flag;    /**< To unblock instantly from rb_read */
+
+    // reader and writer state is kept on separate cache lines, so a reader
+    // updating its fields doesn't evict the lines that writer works on.
+    // Padding instead of _Alignas as ringbuf is allocated by OS_CALLOC
+    OS_CACHELINE_PAD(pad0, 0)
+    char *volatile p_r;          /**< Read pointer */
+    int  threshold_cnt;          /**< Number of threshold slots */
+    int  read_waiters;           /**< Number of readers waiting on can_read */
+    int  read_acquired;          /**< Bytes acquired by rb_read_acquire() */
     bool abort_read;
+    bool is_reach_threshold;
+
+    OS_CACHELINE_PAD(pad1, 0)
+    char *volatile p_w;          /**< Write pointer */
+    int  write_threshold_cnt;    /**< Number of free slots to wake up writer */
+    int  write_waiters;          /**< Number of writers waiting on can_write */
+    int  write_acquired;         /**< Bytes acquired by rb_write_acquire() */
     bool abort_write;
     bool is_done_write;          /**< To signal that we are done writing */
-    bool unblock_reader_flag;    /**< To unblock instantly from rb_read */
-    bool is_reach_threshold;
+    OS_CACHELINE_PAD(pad2, 0)
 };
 
-ringbuf_handle rb_create(int size)
+// rb_sync_offset:
+//   Round @size up so sync primitives stored after it are aligned as malloc()
+static unsigned int rb_sync_offset(unsigned int size)
 {
+    unsigned int align = 2 * sizeof(void *);
+    return (size + align - 1) / align * align;
+}
+
+static ringbuf_handle rb_create_internal(int size, bool mirrored, int node)
+{
+    // mutex and conds are embedded after the ringbuf in a single allocation
+    unsigned int lock_offset = rb_sync_offset(sizeof(struct ringbuf));
+    unsigned int read_offset = lock_offset + rb_sync_offset(os_mutex_storage_size());
+    unsigned int write_offset = read_offset + rb_sync_offset(os_cond_storage_size());
     ringbuf_handle rb;
     char *buf = NULL;
     bool _success =
         (
-            (rb             = OS_CALLOC(1, sizeof(struct ringbuf))) &&
-            (buf            = OS_CALLOC(1, size)) &&
-            (rb->lock       = os_mutex_create()) &&
-            (rb->can_read   = os_cond_create()) &&
-            (rb->can_write  = os_cond_create())
+            (rb             = OS_CALLOC(1, write_offset + os_cond_storage_size())) &&
+            (rb->lock       = os_mutex_init((char *)rb + lock_offset)) &&
+            (rb->can_read   = os_cond_init((char *)rb + read_offset)) &&
+            (rb->can_write  = os_cond_init((char *)rb + write_offset))
         );
 
+    if (_success && mirrored) {
+        unsigned int granularity = os_mirror_granularity();
+        if (granularity > 0) {
+            int mirror_size = (size + granularity - 1) / granularity * granularity;
+            buf = os_mirror_alloc(mirror_size);
+            if (buf != NULL) {
+                size = mirror_size;
+                rb->mirrored = true;
+            }
+        }
+        if (buf == NULL)
+            OS_LOGW(LOG_TAG, "Failed to map mirrored buffer, fallback to normal buffer");
+    }
+    if (_success && buf == NULL && node >= 0) {
+        buf = os_node_alloc(size, node);
+        if (buf != NULL)
+            rb->on_node = true;
+        else
+            OS_LOGW(LOG_TAG, "Failed to allocate buffer on node %d, fallback to normal buffer", node);
+    }
+    if (_success && buf == NULL)
+        _success = (buf = OS_CALLOC(1, size)) != NULL;
+
     if (!_success) {
         rb_destroy(rb);
         return NULL;
@@ -78,18 +129,37 @@ ringbuf_handle rb_create(int size)
     return rb;
 }
 
+ringbuf_handle rb_create(int size)
+{
+    return rb_create_internal(size, false, -1);
+}
+
+ringbuf_handle rb_create_mirrored(int size)
+{
+    return rb_create_internal(size, true, -1);
+}
+
+ringbuf_handle rb_create_on_node(int size, int node)
+{
+    return rb_create_internal(size, false, node);
+}
+
 void rb_destroy(ringbuf_handle rb)
 {
     if (rb == NULL)
         return;
-    if (rb->p_o)
+    if (rb->mirrored)
+        os_mirror_free(rb->p_o, rb->size);
+    else if (rb->on_node)
+        os_node_free(rb->p_o, rb->size);
+    else if (rb->p_o)
         OS_FREE(rb->p_o);
     if (rb->can_read)
-        os_cond_destroy(rb->can_read);
+        os_cond_deinit(rb->can_read);
     if (rb->can_write)
-        os_cond_destroy(rb->can_write);
+        os_cond_deinit(rb->can_write);
     if (rb->lock)
-        os_mutex_destroy(rb->lock);
+        os_mutex_deinit(rb->lock);
     OS_FREE(rb);
 }
 
@@ -98,6 +168,8 @@ void rb_reset(ringbuf_handle rb)
     os_mutex_lock(rb->lock);
     rb->p_r = rb->p_w = rb->p_o;
     rb->fill_cnt = 0;
+    rb->read_acquired = 0;
+    rb->write_acquired = 0;
     rb->is_done_write = false;
     rb->unblock_reader_flag = false;
     rb->abort_read = false;
@@ -106,9 +178,23 @@ void rb_reset(ringbuf_handle rb)
     os_mutex_unlock(rb->lock);
 }
 
+// rb_write_space/rb_read_space:
+//   Free space/filled data that copy paths and acquirers can use. Nothing is
+//   usable while a region is acquired, so other writers/readers wait until
+//   it's committed/released instead of touching bytes owned by the acquirer
+static inline int rb_write_space(ringbuf_handle rb)
+{
+    return rb->write_acquired > 0 ? 0 : rb->size - rb->fill_cnt;
+}
+
+static inline int rb_read_space(ringbuf_handle rb)
+{
+    return rb->read_acquired > 0 ? 0 : rb->fill_cnt;
+}
+
 int rb_bytes_available(ringbuf_handle rb)
 {
-    return (rb->size - rb->fill_cnt);
+    return rb_write_space(rb);
 }
 
 int rb_bytes_filled(ringbuf_handle rb)
@@ -116,18 +202,126 @@ int rb_bytes_filled(ringbuf_handle rb)
     return rb->fill_cnt;
 }
 
+// rb_wait:
+//   Wait on @cond with lock held, @waiters is counted so that the other side
+//   can skip signalling when nobody is waiting
+static inline int rb_wait(ringbuf_handle rb, os_cond cond, int *waiters,
+                          unsigned int timeout_ms, unsigned long long deadline)
+{
+    int ret;
+    (*waiters)++;
+    if (timeout_ms == 0)
+        ret = os_cond_wait(cond, rb->lock);
+    else
+        ret = os_cond_timedwait_until(cond, rb->lock, deadline);
+    (*waiters)--;
+    return ret;
+}
+
+// rb_wake_reader:
+//   Wake up reader with lock held if filled bytes reach reader threshold,
+//   @force is set when we're going to wait, the reader must run to make room
+static inline void rb_wake_reader(ringbuf_handle rb, bool force)
+{
+    if (rb->read_waiters > 0 && (force || rb->is_reach_threshold))
+        os_cond_signal(rb->can_read);
+}
+
+// rb_wake_writer:
+//   Wake up writer with lock held if free bytes reach writer threshold,
+//   @force is set when we're going to wait, the writer must run to fill data.
+//   Without write threshold this is the same single check as rb_wake_reader()
+static inline void rb_wake_writer(ringbuf_handle rb, bool force)
+{
+    if (rb->write_waiters == 0)
+        return;
+    if (force || rb->write_threshold_cnt == 0 ||
+        rb->size - rb->fill_cnt >= rb->write_threshold_cnt)
+        os_cond_signal(rb->can_write);
+}
+
+// rb_copy_out:
+//   Copy @len bytes from read pointer to @buf and advance read pointer
+static void rb_copy_out(ringbuf_handle rb, char *buf, int len)
+{
+    int len1 = rb->p_o + rb->size - rb->p_r;
+    if (rb->mirrored || len <= len1) {
+        memcpy(buf, rb->p_r, len);
+    } else {
+        memcpy(buf, rb->p_r, len1);
+        memcpy(buf + len1, rb->p_o, len - len1);
+    }
+    rb->p_r += len;
+    if (rb->p_r >= rb->p_o + rb->size)
+        rb->p_r -= rb->size;
+}
+
+// rb_copy_in:
+//   Copy @len bytes from @buf to write pointer and advance write pointer
+static void rb_copy_in(ringbuf_handle rb, const char *buf, int len)
+{
+    int len1 = rb->p_o + rb->size - rb->p_w;
+    if (rb->mirrored || len <= len1) {
+        memcpy(rb->p_w, buf, len);
+    } else {
+        memcpy(rb->p_w, buf, len1);
+        memcpy(rb->p_o, buf + len1, len - len1);
+    }
+    rb->p_w += len;
+    if (rb->p_w >= rb->p_o + rb->size)
+        rb->p_w -= rb->size;
+}
+
+// rb_iov_length:
+//   Return total length of @iov, -1 if invalid
+static int rb_iov_length(const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    int i;
+    if (iov == NULL || iovcnt <= 0)
+        return -1;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > INT_MAX - total)
+            return -1;
+        total += iov[i].iov_len;
+    }
+    return (int)total;
+}
+
+static void rb_copy_out_iov(ringbuf_handle rb, const struct iovec *iov, int iovcnt, int len)
+{
+    int i, n;
+    for (i = 0; i < iovcnt && len > 0; i++) {
+        n = iov[i].iov_len < (size_t)len ? (int)iov[i].iov_len : len;
+        rb_copy_out(rb, iov[i].iov_base, n);
+        len -= n;
+    }
+}
+
+static void rb_copy_in_iov(ringbuf_handle rb, const struct iovec *iov, int iovcnt, int len)
+{
+    int i, n;
+    for (i = 0; i < iovcnt && len > 0; i++) {
+        n = iov[i].iov_len < (size_t)len ? (int)iov[i].iov_len : len;
+        rb_copy_in(rb, iov[i].iov_base, n);
+        len -= n;
+    }
+}
+
 int rb_read(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
 {
     int read_size = 0;
     int total_read_size = 0;
     int ret_val = 0;
+    // deadline of all waits below, so spurious wakeups don't extend the timeout
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
 
     //take buffer lock
     os_mutex_lock(rb->lock);
 
     while (buf_len > 0) {
-        if (rb->fill_cnt < buf_len) {
-            read_size = rb->fill_cnt;
+        if (rb_read_space(rb) < buf_len) {
+            read_size = rb_read_space(rb);
             /**
              * When non-multiple of 4(word size) bytes are written to I2S, there is noise.
              * Below is the kind of workaround to read only in multiple of 4. Avoids noise when rb is read in small chunks.
@@ -142,7 +336,8 @@ int rb_read(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
         }
 
         if (read_size == 0 || !rb->is_reach_threshold) {
-            if (rb->is_done_write) {
+            // data held by an acquired region is still to come
+            if (rb->is_done_write && rb->read_acquired == 0) {
                 ret_val = RB_DONE;
                 goto read_err;
             }
@@ -155,12 +350,9 @@ int rb_read(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
                 ret_val = RB_TIMEOUT;
                 goto read_err;
             }
-            os_cond_signal(rb->can_write);
+            rb_wake_writer(rb, true);
             //wait till some data available to read
-            if (timeout_ms == 0)
-                ret_val = os_cond_wait(rb->can_read, rb->lock);
-            else
-                ret_val = os_cond_timedwait(rb->can_read, rb->lock, timeout_ms*1000);
+            ret_val = rb_wait(rb, rb->can_read, &rb->read_waiters, timeout_ms, deadline);
             if (ret_val != 0) {
                 ret_val = RB_TIMEOUT;
                 goto read_err;
@@ -168,16 +360,7 @@ int rb_read(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
             continue;
         }
 
-        if ((rb->p_r + read_size) > (rb->p_o + rb->size)) {
-            int rlen1 = rb->p_o + rb->size - rb->p_r;
-            int rlen2 = read_size - rlen1;
-            memcpy(buf, rb->p_r, rlen1);
-            memcpy(buf + rlen1, rb->p_o, rlen2);
-            rb->p_r = rb->p_o + rlen2;
-        } else {
-            memcpy(buf, rb->p_r, read_size);
-            rb->p_r = rb->p_r + read_size;
-        }
+        rb_copy_out(rb, buf, read_size);
 
         buf_len -= read_size;
         rb->fill_cnt -= read_size;
@@ -187,7 +370,7 @@ int rb_read(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
 
 read_err:
     if (total_read_size > 0) {
-        os_cond_signal(rb->can_write);
+        rb_wake_writer(rb, false);
     }
     os_mutex_unlock(rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
@@ -201,12 +384,13 @@ int rb_write(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
     int write_size = 0;
     int total_write_size = 0;
     int ret_val = 0;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
 
     //take buffer lock
     os_mutex_lock(rb->lock);
 
     while (buf_len > 0) {
-        write_size = rb_bytes_available(rb);
+        write_size = rb_write_space(rb);
         if (buf_len < write_size) {
             write_size = buf_len;
         }
@@ -222,12 +406,9 @@ int rb_write(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
                 rb->is_reach_threshold = true;
                 goto write_err;
             }
-            os_cond_signal(rb->can_read);
+            rb_wake_reader(rb, true);
             //wait till we have some empty space to write
-            if (timeout_ms == 0)
-                ret_val = os_cond_wait(rb->can_write, rb->lock);
-            else
-                ret_val = os_cond_timedwait(rb->can_write, rb->lock, timeout_ms*1000);
+            ret_val = rb_wait(rb, rb->can_write, &rb->write_waiters, timeout_ms, deadline);
             if (ret_val != 0) {
                 ret_val = RB_TIMEOUT;
                 goto write_err;
@@ -235,16 +416,7 @@ int rb_write(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
             continue;
         }
 
-        if ((rb->p_w + write_size) > (rb->p_o + rb->size)) {
-            int wlen1 = rb->p_o + rb->size - rb->p_w;
-            int wlen2 = write_size - wlen1;
-            memcpy(rb->p_w, buf, wlen1);
-            memcpy(rb->p_o, buf + wlen1, wlen2);
-            rb->p_w = rb->p_o + wlen2;
-        } else {
-            memcpy(rb->p_w, buf, write_size);
-            rb->p_w = rb->p_w + write_size;
-        }
+        rb_copy_in(rb, buf, write_size);
 
         buf_len -= write_size;
         rb->fill_cnt += write_size;
@@ -256,8 +428,8 @@ int rb_write(ringbuf_handle rb, char *buf, int buf_len, unsigned int timeout_ms)
     }
 
 write_err:
-    if (rb->is_reach_threshold && total_write_size > 0) {
-        os_cond_signal(rb->can_read);
+    if (total_write_size > 0) {
+        rb_wake_reader(rb, false);
     }
     os_mutex_unlock(rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
@@ -266,19 +438,24 @@ write_err:
     return total_write_size > 0 ? total_write_size : ret_val;
 }
 
-int rb_read_chunk(ringbuf_handle rb, char *buf, int size, unsigned int timeout_ms)
+int rb_readv(ringbuf_handle rb, const struct iovec *iov, int iovcnt, unsigned int timeout_ms)
 {
+    int size = rb_iov_length(iov, iovcnt);
     int read_size = size;
     int total_read_size = 0;
     int ret_val = 0;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+
+    if (size <= 0)
+        return RB_FAIL;
 
     //take buffer lock
     os_mutex_lock(rb->lock);
 
 wait_filled:
-    if (rb->fill_cnt < size) {
+    if (rb_read_space(rb) < size) {
         if (rb->is_done_write)
-            read_size = rb->fill_cnt;
+            read_size = rb_read_space(rb);
         else
             read_size = 0;
     } else {
@@ -286,7 +463,8 @@ wait_filled:
     }
 
     if (read_size == 0 || !rb->is_reach_threshold) {
-        if (rb->is_done_write) {
+        // data held by an acquired region is still to come
+        if (rb->is_done_write && rb->read_acquired == 0) {
             ret_val = RB_DONE;
             goto read_done;
         }
@@ -303,12 +481,9 @@ wait_filled:
             ret_val = RB_FAIL;
             goto read_done;
         }
-        os_cond_signal(rb->can_write);
+        rb_wake_writer(rb, true);
         //wait till some data available to read
-        if (timeout_ms == 0)
-            ret_val = os_cond_wait(rb->can_read, rb->lock);
-        else
-            ret_val = os_cond_timedwait(rb->can_read, rb->lock, timeout_ms*1000);
+        ret_val = rb_wait(rb, rb->can_read, &rb->read_waiters, timeout_ms, deadline);
         if (ret_val != 0) {
             ret_val = RB_TIMEOUT;
             goto read_done;
@@ -316,22 +491,13 @@ wait_filled:
         goto wait_filled;
     }
 
-    if ((rb->p_r + read_size) > (rb->p_o + rb->size)) {
-        int rlen1 = rb->p_o + rb->size - rb->p_r;
-        int rlen2 = read_size - rlen1;
-        memcpy(buf, rb->p_r, rlen1);
-        memcpy(buf + rlen1, rb->p_o, rlen2);
-        rb->p_r = rb->p_o + rlen2;
-    } else {
-        memcpy(buf, rb->p_r, read_size);
-        rb->p_r = rb->p_r + read_size;
-    }
+    rb_copy_out_iov(rb, iov, iovcnt, read_size);
     rb->fill_cnt -= read_size;
     total_read_size += read_size;
 
 read_done:
     if (total_read_size > 0) {
-        os_cond_signal(rb->can_write);
+        rb_wake_writer(rb, false);
     }
     os_mutex_unlock(rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
@@ -340,19 +506,30 @@ read_done:
     return total_read_size > 0 ? total_read_size : ret_val;
 }
 
-int rb_write_chunk(ringbuf_handle rb, char *buf, int size, unsigned int timeout_ms)
+int rb_read_chunk(ringbuf_handle rb, char *buf, int size, unsigned int timeout_ms)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = size > 0 ? size : 0 };
+    return rb_readv(rb, &iov, 1, timeout_ms);
+}
+
+int rb_writev(ringbuf_handle rb, const struct iovec *iov, int iovcnt, unsigned int timeout_ms)
 {
+    int size = rb_iov_length(iov, iovcnt);
     int write_size = 0;
     int total_write_size = 0;
     int ret_val = 0;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+
+    if (size <= 0)
+        return RB_FAIL;
 
     //take buffer lock
     os_mutex_lock(rb->lock);
 
 wait_available:
-    if (rb_bytes_available(rb) < size) {
+    if (rb_write_space(rb) < size) {
         if (rb->is_done_write)
-            write_size = rb_bytes_available(rb);
+            write_size = rb_write_space(rb);
         else
             write_size = 0;
     } else {
@@ -375,12 +552,9 @@ wait_available:
             rb->is_reach_threshold = true;
             goto write_done;
         }
-        os_cond_signal(rb->can_read);
+        rb_wake_reader(rb, true);
         //wait till we have some empty space to write
-        if (timeout_ms == 0)
-            ret_val = os_cond_wait(rb->can_write, rb->lock);
-        else
-            ret_val = os_cond_timedwait(rb->can_write, rb->lock, timeout_ms*1000);
+        ret_val = rb_wait(rb, rb->can_write, &rb->write_waiters, timeout_ms, deadline);
         if (ret_val != 0) {
             ret_val = RB_TIMEOUT;
             goto write_done;
@@ -388,16 +562,7 @@ wait_available:
         goto wait_available;
     }
 
-    if ((rb->p_w + write_size) > (rb->p_o + rb->size)) {
-        int wlen1 = rb->p_o + rb->size - rb->p_w;
-        int wlen2 = write_size - wlen1;
-        memcpy(rb->p_w, buf, wlen1);
-        memcpy(rb->p_o, buf + wlen1, wlen2);
-        rb->p_w = rb->p_o + wlen2;
-    } else {
-        memcpy(rb->p_w, buf, write_size);
-        rb->p_w = rb->p_w + write_size;
-    }
+    rb_copy_in_iov(rb, iov, iovcnt, write_size);
     rb->fill_cnt += write_size;
     total_write_size += write_size;
 
@@ -405,8 +570,8 @@ wait_available:
         rb->is_reach_threshold = true;
 
 write_done:
-    if (rb->is_reach_threshold && total_write_size > 0) {
-        os_cond_signal(rb->can_read);
+    if (total_write_size > 0) {
+        rb_wake_reader(rb, false);
     }
     os_mutex_unlock(rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
@@ -415,6 +580,214 @@ write_done:
     return total_write_size > 0 ? total_write_size : ret_val;
 }
 
+int rb_write_chunk(ringbuf_handle rb, char *buf, int size, unsigned int timeout_ms)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = size > 0 ? size : 0 };
+    return rb_writev(rb, &iov, 1, timeout_ms);
+}
+
+// rb_get_region:
+//   Split @len bytes starting from @p into at most two contiguous regions,
+//   mirrored buffer always gives a single region
+static void rb_get_region(ringbuf_handle rb, char *p, int len, struct rb_region region[2])
+{
+    int len1 = rb->p_o + rb->size - p;
+    if (rb->mirrored || len1 > len)
+        len1 = len;
+    region[0].buf = p;
+    region[0].len = len1;
+    region[1].buf = rb->p_o;
+    region[1].len = len - len1;
+}
+
+int rb_write_acquire(ringbuf_handle rb, struct rb_region region[2], int size, unsigned int timeout_ms)
+{
+    int write_size = 0;
+    int ret_val = 0;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+
+    if (region == NULL || size <= 0)
+        return RB_FAIL;
+
+    //take buffer lock
+    os_mutex_lock(rb->lock);
+
+    // wait for the region acquired by others to be committed as well
+    while ((write_size = rb_write_space(rb)) == 0) {
+        if (rb->is_done_write) {
+            ret_val = RB_DONE;
+            rb->is_reach_threshold = true;
+            goto acquire_done;
+        }
+        if (rb->abort_write) {
+            ret_val = RB_ABORT;
+            rb->is_reach_threshold = true;
+            goto acquire_done;
+        }
+        rb_wake_reader(rb, true);
+        //wait till we have some empty space to write
+        ret_val = rb_wait(rb, rb->can_write, &rb->write_waiters, timeout_ms, deadline);
+        if (ret_val != 0) {
+            ret_val = RB_TIMEOUT;
+            goto acquire_done;
+        }
+    }
+
+    if (write_size > size)
+        write_size = size;
+    rb_get_region(rb, rb->p_w, write_size, region);
+    rb->write_acquired = write_size;
+    ret_val = write_size;
+
+acquire_done:
+    os_mutex_unlock(rb->lock);
+    return ret_val;
+}
+
+int rb_write_commit(ringbuf_handle rb, int len)
+{
+    int ret_val = RB_OK;
+
+    os_mutex_lock(rb->lock);
+    if (len < 0 || len > rb->write_acquired) {
+        OS_LOGE(LOG_TAG, "Invalid commit length %d, acquired %d", len, rb->write_acquired);
+        ret_val = RB_FAIL;
+        goto commit_done;
+    }
+
+    rb->p_w += len;
+    if (rb->p_w >= rb->p_o + rb->size)
+        rb->p_w -= rb->size;
+    rb->fill_cnt += len;
+    rb->write_acquired = 0;
+
+    if (!rb->is_reach_threshold && rb->fill_cnt >= rb->threshold_cnt)
+        rb->is_reach_threshold = true;
+    if (len > 0)
+        rb_wake_reader(rb, false);
+    // writers and acquirers blocked by the region can go on
+    if (rb->write_waiters > 0)
+        os_cond_broadcast(rb->can_write);
+
+commit_done:
+    os_mutex_unlock(rb->lock);
+    return ret_val;
+}
+
+int rb_read_acquire(ringbuf_handle rb, struct rb_region region[2], int size, unsigned int timeout_ms)
+{
+    int read_size = 0;
+    int ret_val = 0;
+    unsigned long long deadline = os_monotonic_usec() + (unsigned long long)timeout_ms * 1000;
+
+    if (region == NULL || size <= 0)
+        return RB_FAIL;
+
+    //take buffer lock
+    os_mutex_lock(rb->lock);
+
+    // wait for the region acquired by others to be released as well
+    while ((read_size = rb_read_space(rb)) == 0 || !rb->is_reach_threshold) {
+        if (rb->is_done_write && rb->read_acquired == 0) {
+            ret_val = RB_DONE;
+            goto acquire_done;
+        }
+        if (rb->abort_read) {
+            ret_val = RB_ABORT;
+            goto acquire_done;
+        }
+        if (rb->unblock_reader_flag) {
+            //reader_unblock is nothing but forced timeout
+            ret_val = RB_TIMEOUT;
+            goto acquire_done;
+        }
+        rb_wake_writer(rb, true);
+        //wait till some data available to read
+        ret_val = rb_wait(rb, rb->can_read, &rb->read_waiters, timeout_ms, deadline);
+        if (ret_val != 0) {
+            ret_val = RB_TIMEOUT;
+            goto acquire_done;
+        }
+    }
+
+    if (read_size > size)
+        read_size = size;
+    rb_get_region(rb, rb->p_r, read_size, region);
+    rb->read_acquired = read_size;
+    ret_val = read_size;
+
+acquire_done:
+    os_mutex_unlock(rb->lock);
+    return ret_val;
+}
+
+int rb_read_release(ringbuf_handle rb, int len)
+{
+    int ret_val = RB_OK;
+
+    os_mutex_lock(rb->lock);
+    if (len < 0 || len > rb->read_acquired) {
+        OS_LOGE(LOG_TAG, "Invalid release length %d, acquired %d", len, rb->read_acquired);
+        ret_val = RB_FAIL;
+        goto release_done;
+    }
+
+    rb->p_r += len;
+    if (rb->p_r >= rb->p_o + rb->size)
+        rb->p_r -= rb->size;
+    rb->fill_cnt -= len;
+    rb->read_acquired = 0;
+
+    if (len > 0)
+        rb_wake_writer(rb, false);
+    // readers and acquirers blocked by the region can go on
+    if (rb->read_waiters > 0)
+        os_cond_broadcast(rb->can_read);
+
+release_done:
+    os_mutex_unlock(rb->lock);
+    return ret_val;
+}
+
+#if !defined(OS_RTOS)
+// rb_region_to_iov:
+//   Convert acquired regions to iovec, return number of iovec
+static int rb_region_to_iov(struct rb_region region[2], struct iovec iov[2])
+{
+    iov[0].iov_base = region[0].buf;
+    iov[0].iov_len = region[0].len;
+    iov[1].iov_base = region[1].buf;
+    iov[1].iov_len = region[1].len;
+    return region[1].len > 0 ? 2 : 1;
+}
+
+int rb_write_from_fd(ringbuf_handle rb, int fd, int len, unsigned int timeout_ms)
+{
+    struct rb_region region[2];
+    struct iovec iov[2];
+    ssize_t ret;
+    int acquired = rb_write_acquire(rb, region, len, timeout_ms);
+    if (acquired <= 0)
+        return acquired;
+    ret = readv(fd, iov, rb_region_to_iov(region, iov));
+    rb_write_commit(rb, ret > 0 ? (int)ret : 0);
+    return ret >= 0 ? (int)ret : RB_FAIL;
+}
+
+int rb_read_to_fd(ringbuf_handle rb, int fd, int len, unsigned int timeout_ms)
+{
+    struct rb_region region[2];
+    struct iovec iov[2];
+    ssize_t ret;
+    int acquired = rb_read_acquire(rb, region, len, timeout_ms);
+    if (acquired <= 0)
+        return acquired;
+    ret = writev(fd, iov, rb_region_to_iov(region, iov));
+    rb_read_release(rb, ret > 0 ? (int)ret : 0);
+    return ret >= 0 ? (int)ret : RB_FAIL;
+}
+#endif
+
 static void rb_abort_read(ringbuf_handle rb)
 {
     os_mutex_lock(rb->lock);
@@ -488,6 +861,18 @@ int rb_get_threshold(ringbuf_handle rb)
     return rb->threshold_cnt;
 }
 
+void rb_set_write_threshold(ringbuf_handle rb, int threshold)
+{
+    os_mutex_lock(rb->lock);
+    rb->write_threshold_cnt = threshold <= rb->size ? threshold : rb->size;
+    os_mutex_unlock(rb->lock);
+}
+
+int rb_get_write_threshold(ringbuf_handle rb)
+{
+    return rb->write_threshold_cnt;
+}
+
 bool rb_reach_threshold(ringbuf_handle rb)
 {
     return rb->is_reach_threshold;
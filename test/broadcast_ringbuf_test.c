@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include "osal/os_thread.h"
+#include "osal/os_time.h"
+#include "cutils/memory_helper.h"
+#include "cutils/log_helper.h"
+#include "cutils/broadcast_ringbuf.h"
+
+#define LOG_TAG "broadcast_ringbuf_test"
+
+#define RINGBUF_SIZE        1024
+#define TOTAL_SIZE          (64 * 1024)
+#define WRITE_CHUNK         256
+#define SLOW_READ_CHUNK     128
+
+static brb_handle rb = NULL;
+static brb_reader_handle slow_reader = NULL;
+static brb_reader_handle drop_reader = NULL;
+static brb_reader_handle abort_reader = NULL;
+
+static int slow_received = 0;
+static int slow_bad = 0;
+static int slow_result = 0;
+
+// byte at position pos of stream is (pos & 0xff), readers check it
+static int check_data(const char *buf, int len, unsigned long long pos)
+{
+    int i, bad = 0;
+    for (i = 0; i < len; i++) {
+        if ((unsigned char)buf[i] != (unsigned char)((pos + i) & 0xff))
+            bad++;
+    }
+    return bad;
+}
+
+static void *write_thread(void *arg)
+{
+    char buf[WRITE_CHUNK];
+    int written = 0, i, ret;
+
+    while (written < TOTAL_SIZE) {
+        for (i = 0; i < WRITE_CHUNK; i++)
+            buf[i] = (char)((written + i) & 0xff);
+        ret = brb_write(rb, buf, WRITE_CHUNK, 5000);
+        if (ret != WRITE_CHUNK) {
+            OS_LOGE(LOG_TAG, "Failed to write, ret=[%d]", ret);
+            break;
+        }
+        written += ret;
+    }
+    brb_done_write(rb);
+    return NULL;
+}
+
+// slow_read_thread:
+//   Reader without drop_if_slow, writer must wait for it, so every byte is
+//   received even if it's much slower than writer
+static void *slow_read_thread(void *arg)
+{
+    char buf[SLOW_READ_CHUNK];
+    int ret;
+
+    while ((ret = brb_read(slow_reader, buf, sizeof(buf), 5000)) > 0) {
+        slow_bad += check_data(buf, ret, slow_received);
+        slow_received += ret;
+        os_thread_sleep_usec(200);
+    }
+    slow_result = ret;
+    return NULL;
+}
+
+int main()
+{
+    os_thread writer, reader;
+    char buf[RINGBUF_SIZE];
+    unsigned long long dropped;
+    int received = 0, bad = 0, ret;
+
+    rb = brb_create(RINGBUF_SIZE);
+    if (rb == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate broadcast ringbuf");
+        return -1;
+    }
+    slow_reader = brb_add_reader(rb, false);
+    drop_reader = brb_add_reader(rb, true);
+    abort_reader = brb_add_reader(rb, false);
+    if (slow_reader == NULL || drop_reader == NULL || abort_reader == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to add reader");
+        goto error;
+    }
+
+    // aborted reader never reads, writer mustn't wait for it
+    brb_reader_abort(abort_reader);
+    ret = brb_read(abort_reader, buf, sizeof(buf), 0);
+    if (ret == RB_ABORT)
+        OS_LOGI(LOG_TAG, "Succeed to abort reader");
+    else
+        OS_LOGE(LOG_TAG, "Aborted reader returns [%d] instead of RB_ABORT", ret);
+
+    writer = os_thread_create(NULL, write_thread, NULL);
+    reader = os_thread_create(NULL, slow_read_thread, NULL);
+    os_thread_join(writer, NULL);
+    os_thread_join(reader, NULL);
+
+    if (slow_received == TOTAL_SIZE && slow_bad == 0 && slow_result == RB_DONE &&
+        brb_reader_dropped(slow_reader) == 0)
+        OS_LOGI(LOG_TAG, "Succeed to receive all %d bytes by slow reader", slow_received);
+    else
+        OS_LOGE(LOG_TAG, "Slow reader received [%d] bytes, bad [%d], result [%d], dropped [%llu]",
+                slow_received, slow_bad, slow_result, brb_reader_dropped(slow_reader));
+
+    // drop_if_slow reader hasn't read anything, only the latest data is kept
+    dropped = brb_reader_dropped(drop_reader);
+    if (brb_reader_bytes_filled(drop_reader) > RINGBUF_SIZE)
+        OS_LOGE(LOG_TAG, "Bytes filled of drop reader exceeds ringbuf size");
+    while ((ret = brb_read(drop_reader, buf, sizeof(buf), 1000)) > 0) {
+        bad += check_data(buf, ret, dropped + received);
+        received += ret;
+    }
+    if (ret == RB_DONE && bad == 0 && dropped > 0 && received <= RINGBUF_SIZE &&
+        dropped + received == TOTAL_SIZE)
+        OS_LOGI(LOG_TAG, "Succeed to receive %d bytes by drop reader, dropped %llu bytes",
+                received, dropped);
+    else
+        OS_LOGE(LOG_TAG, "Drop reader received [%d] bytes, bad [%d], result [%d], dropped [%llu]",
+                received, bad, ret, dropped);
+
+    ret = brb_read(abort_reader, buf, sizeof(buf), 0);
+    if (ret == RB_ABORT && brb_reader_bytes_filled(abort_reader) == 0)
+        OS_LOGI(LOG_TAG, "Succeed to keep aborted reader aborted");
+    else
+        OS_LOGE(LOG_TAG, "Aborted reader returns [%d], bytes filled [%d]",
+                ret, brb_reader_bytes_filled(abort_reader));
+
+error:
+    brb_destroy(rb);
+    OS_MEMORY_DUMP();
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include "osal/os_thread.h"
+#include "osal/os_time.h"
+#include "cutils/memory_helper.h"
+#include "cutils/log_helper.h"
+#include "cutils/ringbuf.h"
+#include "cutils/mqueue.h"
+
+#define LOG_TAG "cacheline_pad_test"
+
+// Built twice, as cacheline_pad_test against padded library and as
+// cacheline_pad_test_nopad against library built with
+// SYSUTILS_HAVE_CACHELINE_PAD_DISABLED, run both to compare
+#if defined(SYSUTILS_HAVE_CACHELINE_PAD_DISABLED)
+#define PAD_MODE            "unpadded"
+#else
+#define PAD_MODE            "padded"
+#endif
+
+#define RINGBUF_SIZE        4096
+#define RINGBUF_TOTAL       (64 * 1024 * 1024)
+#define RINGBUF_CHUNK       64
+#define QUEUE_LENGTH        256
+#define QUEUE_MSG_COUNT     2000000
+#define QUEUE_BATCH         32
+
+static ringbuf_handle rb = NULL;
+static mq_handle queue = NULL;
+
+static void *rb_write_thread(void *arg)
+{
+    char buf[RINGBUF_CHUNK];
+    int written, ret;
+
+    memset(buf, 0x5a, sizeof(buf));
+    for (written = 0; written < RINGBUF_TOTAL; written += ret) {
+        ret = rb_write(rb, buf, sizeof(buf), 5000);
+        if (ret <= 0)
+            break;
+    }
+    rb_done_write(rb);
+    return NULL;
+}
+
+// ringbuf_pad_test:
+//   One writer and one reader move small chunks, reader updates p_r while
+//   writer updates p_w, they share a cache line if padding is disabled
+static void ringbuf_pad_test(void)
+{
+    char buf[RINGBUF_CHUNK];
+    unsigned long long received = 0, start, cost;
+    os_thread writer;
+    int ret;
+
+    rb = rb_create(RINGBUF_SIZE);
+    if (rb == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create ringbuf");
+        return;
+    }
+
+    start = os_monotonic_usec();
+    writer = os_thread_create(NULL, rb_write_thread, NULL);
+    while ((ret = rb_read(rb, buf, sizeof(buf), 5000)) > 0)
+        received += ret;
+    os_thread_join(writer, NULL);
+    cost = os_monotonic_usec() - start;
+
+    if (received == RINGBUF_TOTAL)
+        OS_LOGI(LOG_TAG, "ringbuf (%s): %llu MB/s", PAD_MODE,
+                cost > 0 ? received / cost : 0);
+    else
+        OS_LOGE(LOG_TAG, "ringbuf (%s): received [%llu] bytes", PAD_MODE, received);
+    rb_destroy(rb);
+    rb = NULL;
+}
+
+static void *mq_send_thread(void *arg)
+{
+    unsigned int msgs[QUEUE_BATCH];
+    unsigned int i, k, sent;
+    int ret;
+
+    for (i = 0; i < QUEUE_MSG_COUNT; i += QUEUE_BATCH) {
+        for (k = 0; k < QUEUE_BATCH; k++)
+            msgs[k] = i + k;
+        for (sent = 0; sent < QUEUE_BATCH; sent += ret) {
+            ret = mqueue_send_batch(queue, (char *)&msgs[sent], QUEUE_BATCH - sent, 5000);
+            if (ret < 0)
+                return NULL;
+        }
+    }
+    return NULL;
+}
+
+// mqueue_pad_test:
+//   One sender and one receiver on a lock-free queue, sender CASes
+//   enqueue_pos while receiver CASes dequeue_pos
+static void mqueue_pad_test(void)
+{
+    unsigned int msgs[QUEUE_BATCH];
+    unsigned long long sum = 0, start, cost;
+    unsigned int received = 0;
+    os_thread sender;
+    int ret, i;
+
+    queue = mqueue_create_lockfree(sizeof(unsigned int), QUEUE_LENGTH);
+    if (queue == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create queue");
+        return;
+    }
+
+    start = os_monotonic_usec();
+    sender = os_thread_create(NULL, mq_send_thread, NULL);
+    while (received < QUEUE_MSG_COUNT &&
+           (ret = mqueue_receive_batch(queue, (char *)msgs, QUEUE_BATCH, 5000)) > 0) {
+        for (i = 0; i < ret; i++)
+            sum += msgs[i];
+        received += ret;
+    }
+    os_thread_join(sender, NULL);
+    cost = os_monotonic_usec() - start;
+
+    if (sum == (unsigned long long)QUEUE_MSG_COUNT * (QUEUE_MSG_COUNT - 1) / 2)
+        OS_LOGI(LOG_TAG, "mqueue (%s): %llu msgs/ms", PAD_MODE,
+                cost > 0 ? (unsigned long long)received * 1000 / cost : 0);
+    else
+        OS_LOGE(LOG_TAG, "mqueue (%s): received [%u] msgs", PAD_MODE, received);
+    mqueue_destroy(queue);
+    queue = NULL;
+}
+
+int main()
+{
+    ringbuf_pad_test();
+    mqueue_pad_test();
+    OS_MEMORY_DUMP();
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <string.h>
+#include "osal/os_thread.h"
+#include "osal/os_time.h"
+#include "cutils/memory_helper.h"
+#include "cutils/log_helper.h"
+#include "cutils/lockfree_ringbuf.h"
+
+#define LOG_TAG "lockfree_ringbuf_test"
+
+#define RINGBUF_SIZE        4096
+#define TOTAL_SIZE          (64 * 1024 * 1024)
+#define MAX_CHUNK           (RINGBUF_SIZE + 1000)
+
+// odd chunk sizes, so reads and writes split at every offset of the buffer
+static const int write_chunks[] = { 1, 7, 64, 333, 1000, 4095, MAX_CHUNK };
+static const int read_chunks[] = { 3, 5, 128, 777, 2048, MAX_CHUNK, 11 };
+
+static void *rb = NULL;
+static int write_result = 0;
+
+// byte at position pos of stream is (pos % 251), the period isn't a divisor
+// of buffer size, so data left from a previous wrap never looks right
+static void fill_data(char *buf, int len, unsigned long long pos)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        buf[i] = (char)((pos + i) % 251);
+}
+
+static int check_data(const char *buf, int len, unsigned long long pos)
+{
+    int i, bad = 0;
+    for (i = 0; i < len; i++) {
+        if ((unsigned char)buf[i] != (unsigned char)((pos + i) % 251))
+            bad++;
+    }
+    return bad;
+}
+
+static void *write_thread(void *arg)
+{
+    static char buf[MAX_CHUNK];
+    unsigned long long written = 0;
+    int i = 0, len, ret;
+
+    while (written < TOTAL_SIZE) {
+        len = write_chunks[i++ % (sizeof(write_chunks)/sizeof(write_chunks[0]))];
+        if (len > TOTAL_SIZE - written)
+            len = TOTAL_SIZE - written;
+        fill_data(buf, len, written);
+        ret = lockfree_ringbuf_write_wait(rb, buf, len, 5000);
+        if (ret != len) {
+            OS_LOGE(LOG_TAG, "Failed to write, ret=[%d]", ret);
+            write_result = ret;
+            break;
+        }
+        written += ret;
+    }
+    lockfree_ringbuf_done_write(rb);
+    return NULL;
+}
+
+// spsc_test:
+//   One writer and one reader move TOTAL_SIZE bytes through the ringbuf with
+//   mismatched chunk sizes, wrapping around thousands of times. Every byte
+//   must arrive in order, throughput is printed for comparison
+static void spsc_test(const char *name, void *(*create)(int size))
+{
+    static char buf[MAX_CHUNK];
+    unsigned long long received = 0, start, cost;
+    os_thread writer;
+    int i = 0, bad = 0, ret;
+
+    rb = create(RINGBUF_SIZE);
+    if (rb == NULL) {
+        OS_LOGE(LOG_TAG, "%s: Failed to create ringbuf", name);
+        return;
+    }
+    write_result = 0;
+
+    start = os_monotonic_usec();
+    writer = os_thread_create(NULL, write_thread, NULL);
+    for (;;) {
+        ret = lockfree_ringbuf_read_wait(rb, buf, read_chunks[i++ % (sizeof(read_chunks)/sizeof(read_chunks[0]))], 5000);
+        if (ret <= 0)
+            break;
+        bad += check_data(buf, ret, received);
+        received += ret;
+    }
+    os_thread_join(writer, NULL);
+    cost = os_monotonic_usec() - start;
+
+    if (received == TOTAL_SIZE && bad == 0 && ret == LOCKFREE_RINGBUF_DONE && write_result == 0)
+        OS_LOGI(LOG_TAG, "%s: succeed to move %d MB over %d wraps, %llu MB/s",
+                name, TOTAL_SIZE >> 20, TOTAL_SIZE / RINGBUF_SIZE,
+                cost > 0 ? (unsigned long long)TOTAL_SIZE / cost : 0);
+    else
+        OS_LOGE(LOG_TAG, "%s: received [%llu] bytes, bad [%d], result [%d]/[%d]",
+                name, received, bad, ret, write_result);
+    lockfree_ringbuf_destroy(rb);
+    rb = NULL;
+}
+
+int main()
+{
+    spsc_test("lockfree_ringbuf_create", lockfree_ringbuf_create);
+    spsc_test("lockfree_ringbuf_create_mirrored", lockfree_ringbuf_create_mirrored);
+    OS_MEMORY_DUMP();
+    return 0;
+}
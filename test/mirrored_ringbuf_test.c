@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "osal/os_memory.h"
+#include "cutils/memory_helper.h"
+#include "cutils/log_helper.h"
+#include "cutils/ringbuf.h"
+#include "cutils/lockfree_ringbuf.h"
+
+#define LOG_TAG "mirrored_ringbuf_test"
+
+#define RINGBUF_SIZE        4096
+#define HEAD_SIZE           3000 // moves read and write position near the end
+#define WRAP_SIZE           2000 // HEAD_SIZE + WRAP_SIZE crosses the wrap point
+
+// byte at position pos of stream is (pos % 251), so bytes written before the
+// wrap point never look like bytes written after it
+static void fill_data(char *buf, int len, int pos)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        buf[i] = (char)((pos + i) % 251);
+}
+
+static int check_data(const char *buf, int len, int pos)
+{
+    int i, bad = 0;
+    for (i = 0; i < len; i++) {
+        if ((unsigned char)buf[i] != (unsigned char)((pos + i) % 251))
+            bad++;
+    }
+    return bad;
+}
+
+// rb_mirrored_test:
+//   Regions acquired across the wrap point of rb_create_mirrored() buffer are
+//   single contiguous spans, and data written through them or by rb_write()
+//   reads back intact
+static void rb_mirrored_test(void)
+{
+    struct rb_region region[2];
+    char buf[HEAD_SIZE];
+    int ret, bad = 0;
+
+    ringbuf_handle rb = rb_create_mirrored(RINGBUF_SIZE);
+    if (rb == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create mirrored ringbuf");
+        return;
+    }
+
+    fill_data(buf, HEAD_SIZE, 0);
+    rb_write(rb, buf, HEAD_SIZE, 0);
+    rb_read(rb, buf, HEAD_SIZE, 0);
+
+    // write in place across the wrap point
+    ret = rb_write_acquire(rb, region, WRAP_SIZE, 0);
+    if (ret != WRAP_SIZE || region[0].len != WRAP_SIZE || region[1].len != 0) {
+        OS_LOGE(LOG_TAG, "rb: write acquire returns [%d], regions [%d]/[%d]",
+                ret, region[0].len, region[1].len);
+        goto out;
+    }
+    fill_data(region[0].buf, WRAP_SIZE, HEAD_SIZE);
+    rb_write_commit(rb, WRAP_SIZE);
+
+    // read in place across the wrap point
+    ret = rb_read_acquire(rb, region, WRAP_SIZE, 0);
+    if (ret != WRAP_SIZE || region[0].len != WRAP_SIZE || region[1].len != 0) {
+        OS_LOGE(LOG_TAG, "rb: read acquire returns [%d], regions [%d]/[%d]",
+                ret, region[0].len, region[1].len);
+        goto out;
+    }
+    bad += check_data(region[0].buf, WRAP_SIZE, HEAD_SIZE);
+    rb_read_release(rb, WRAP_SIZE);
+
+    // copy in and out across the wrap point again
+    fill_data(buf, WRAP_SIZE, HEAD_SIZE + WRAP_SIZE);
+    rb_write(rb, buf, WRAP_SIZE, 0);
+    memset(buf, 0x0, WRAP_SIZE);
+    ret = rb_read(rb, buf, WRAP_SIZE, 0);
+    bad += check_data(buf, WRAP_SIZE, HEAD_SIZE + WRAP_SIZE);
+
+    if (ret == WRAP_SIZE && bad == 0)
+        OS_LOGI(LOG_TAG, "rb: succeed to write and read across wrap point");
+    else
+        OS_LOGE(LOG_TAG, "rb: read [%d] bytes, bad [%d]", ret, bad);
+out:
+    rb_destroy(rb);
+}
+
+// lockfree_mirrored_test:
+//   Data of lockfree_ringbuf_create_mirrored() buffer copied and moved by fd
+//   helpers across the wrap point reads back intact
+static void lockfree_mirrored_test(void)
+{
+    char buf[HEAD_SIZE];
+    int fds[2] = { -1, -1 };
+    int ret, bad = 0;
+
+    void *rb = lockfree_ringbuf_create_mirrored(RINGBUF_SIZE);
+    if (rb == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create mirrored lockfree ringbuf");
+        return;
+    }
+
+    fill_data(buf, HEAD_SIZE, 0);
+    lockfree_ringbuf_write(rb, buf, HEAD_SIZE);
+    lockfree_ringbuf_read(rb, buf, HEAD_SIZE);
+
+    // copy in and out across the wrap point
+    fill_data(buf, WRAP_SIZE, HEAD_SIZE);
+    lockfree_ringbuf_write(rb, buf, WRAP_SIZE);
+    memset(buf, 0x0, WRAP_SIZE);
+    ret = lockfree_ringbuf_read(rb, buf, WRAP_SIZE);
+    bad += check_data(buf, WRAP_SIZE, HEAD_SIZE);
+    if (ret != WRAP_SIZE || bad != 0) {
+        OS_LOGE(LOG_TAG, "lockfree: read [%d] bytes, bad [%d]", ret, bad);
+        goto out;
+    }
+
+    // move from pipe into ringbuf and back across the wrap point, the region
+    // is a single iovec as buffer is mirrored
+    if (pipe(fds) != 0) {
+        OS_LOGE(LOG_TAG, "Failed to create pipe");
+        goto out;
+    }
+    fill_data(buf, WRAP_SIZE, HEAD_SIZE + WRAP_SIZE);
+    if (write(fds[1], buf, WRAP_SIZE) != WRAP_SIZE) {
+        OS_LOGE(LOG_TAG, "Failed to write pipe");
+        goto out;
+    }
+    ret = lockfree_ringbuf_write_from_fd(rb, fds[0], WRAP_SIZE);
+    if (ret != WRAP_SIZE) {
+        OS_LOGE(LOG_TAG, "lockfree: write from fd returns [%d]", ret);
+        goto out;
+    }
+    ret = lockfree_ringbuf_read_to_fd(rb, fds[1], WRAP_SIZE);
+    if (ret != WRAP_SIZE) {
+        OS_LOGE(LOG_TAG, "lockfree: read to fd returns [%d]", ret);
+        goto out;
+    }
+    memset(buf, 0x0, WRAP_SIZE);
+    ret = read(fds[0], buf, WRAP_SIZE);
+    bad += check_data(buf, WRAP_SIZE, HEAD_SIZE + WRAP_SIZE);
+
+    if (ret == WRAP_SIZE && bad == 0)
+        OS_LOGI(LOG_TAG, "lockfree: succeed to write and read across wrap point");
+    else
+        OS_LOGE(LOG_TAG, "lockfree: read [%d] bytes from pipe, bad [%d]", ret, bad);
+out:
+    if (fds[0] >= 0)
+        close(fds[0]);
+    if (fds[1] >= 0)
+        close(fds[1]);
+    lockfree_ringbuf_destroy(rb);
+}
+
+int main()
+{
+    if (os_mirror_granularity() == 0) {
+        OS_LOGW(LOG_TAG, "Mirrored memory isn't supported, skip");
+        return 0;
+    }
+    if (RINGBUF_SIZE % os_mirror_granularity() != 0) {
+        OS_LOGW(LOG_TAG, "Ringbuf size isn't multiple of %u, skip", os_mirror_granularity());
+        return 0;
+    }
+
+    rb_mirrored_test();
+    lockfree_mirrored_test();
+    OS_MEMORY_DUMP();
+    return 0;
+}
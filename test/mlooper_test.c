@@ -7,6 +7,14 @@
 
 #define LOG_TAG "msglooper_test"
 
+#define ORDER_MAX_COUNT     16
+
+#define LOCKFREE_POSTERS    4
+#define LOCKFREE_MSG_COUNT  1000
+
+#define NODE_POOL_MSG_COUNT 4
+#define NODE_POOL_BUF_SIZE  32
+
 struct priv_data {
     const char *str;
 };
@@ -43,6 +51,373 @@ static void msg_timeout(struct message *msg)
     OS_LOGE(LOG_TAG, "--> Timeout message: what=[%d]", msg->what);
 }
 
+// Messages of the focused tests below carry an id in arg1, handler records
+// the order they are handled in
+static volatile int order_count = 0;
+static int order_ids[ORDER_MAX_COUNT];
+
+static void order_handle(struct message *msg)
+{
+    if (order_count < ORDER_MAX_COUNT)
+        order_ids[order_count] = msg->arg1;
+    order_count++;
+}
+
+static void order_free(struct message *msg)
+{
+}
+
+// check_order:
+//   Wait at most 1s for @count messages handled, then compare with @expected
+static bool check_order(const char *name, const int *expected, int count)
+{
+    int i;
+    for (i = 0; i < 100 && order_count < count; i++)
+        os_thread_sleep_msec(10);
+    if (order_count != count) {
+        OS_LOGE(LOG_TAG, "%s: handled [%d] messages, expected [%d]", name, order_count, count);
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        if (order_ids[i] != expected[i]) {
+            OS_LOGE(LOG_TAG, "%s: message [%d] is handled at [%d]", name, order_ids[i], i);
+            return false;
+        }
+    }
+    OS_LOGI(LOG_TAG, "%s: succeed to handle %d messages in order", name, count);
+    return true;
+}
+
+static mlooper_handle order_looper_create(struct mlooper_attr *mattr)
+{
+    order_count = 0;
+    return mlooper_create_with_attr(mattr, order_handle, order_free);
+}
+
+// order_test:
+//   Due messages are handled first-in first-out, delayed messages in order of
+//   their deadline whatever order they are posted in
+static void order_test(struct mlooper_attr *mattr)
+{
+    static const int expected[] = { 10, 11, 12, 1, 2, 3 };
+    mlooper_handle looper = order_looper_create(mattr);
+    if (looper == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper");
+        return;
+    }
+
+    // queue everything before starting, so order depends on scheduling only
+    mlooper_post_message_delay(looper, message_obtain(0, 3, 0, NULL), 30);
+    mlooper_post_message(looper, message_obtain(0, 10, 0, NULL));
+    mlooper_post_message_delay(looper, message_obtain(0, 1, 0, NULL), 10);
+    mlooper_post_message(looper, message_obtain(0, 11, 0, NULL));
+    mlooper_post_message_delay(looper, message_obtain(0, 2, 0, NULL), 20);
+    mlooper_post_message(looper, message_obtain(0, 12, 0, NULL));
+    mlooper_start(looper);
+
+    check_order("order_test", expected, sizeof(expected)/sizeof(expected[0]));
+    mlooper_destroy(looper);
+}
+
+static mlooper_handle lockfree_looper = NULL;
+static volatile int lockfree_count = 0;
+static int lockfree_next[LOCKFREE_POSTERS];
+static int lockfree_bad = 0;
+
+// lockfree_handle:
+//   arg1 is poster index and arg2 is sequence of the poster, messages of the
+//   same poster must be handled in posting order
+static void lockfree_handle(struct message *msg)
+{
+    if (msg->arg2 != lockfree_next[msg->arg1])
+        lockfree_bad++;
+    lockfree_next[msg->arg1] = msg->arg2 + 1;
+    lockfree_count++;
+}
+
+static void *lockfree_post_thread(void *arg)
+{
+    int poster = (int)(long)arg;
+    for (int i = 0; i < LOCKFREE_MSG_COUNT; i++)
+        mlooper_post_message(lockfree_looper, message_obtain(0, poster, i, NULL));
+    return NULL;
+}
+
+// lockfree_post_test:
+//   Many threads post to a MLOOPER_FLAG_LOCKFREE_POST looper at the same time,
+//   no message is lost and each poster's messages keep their order
+static void lockfree_post_test(struct mlooper_attr *mattr)
+{
+    struct mlooper_attr lockfree_attr = *mattr;
+    os_thread tids[LOCKFREE_POSTERS];
+    int i;
+
+    lockfree_attr.flags |= MLOOPER_FLAG_LOCKFREE_POST;
+    lockfree_looper = mlooper_create_with_attr(&lockfree_attr, lockfree_handle, order_free);
+    if (lockfree_looper == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper");
+        return;
+    }
+    mlooper_start(lockfree_looper);
+
+    for (i = 0; i < LOCKFREE_POSTERS; i++)
+        tids[i] = os_thread_create(NULL, lockfree_post_thread, (void *)(long)i);
+    for (i = 0; i < LOCKFREE_POSTERS; i++)
+        os_thread_join(tids[i], NULL);
+    for (i = 0; i < 100 && lockfree_count < LOCKFREE_POSTERS * LOCKFREE_MSG_COUNT; i++)
+        os_thread_sleep_msec(10);
+
+    if (lockfree_count == LOCKFREE_POSTERS * LOCKFREE_MSG_COUNT && lockfree_bad == 0)
+        OS_LOGI(LOG_TAG, "lockfree_post_test: succeed to handle %d messages from %d posters",
+                lockfree_count, LOCKFREE_POSTERS);
+    else
+        OS_LOGE(LOG_TAG, "lockfree_post_test: handled [%d] messages, [%d] out of order",
+                lockfree_count, lockfree_bad);
+    mlooper_destroy(lockfree_looper);
+}
+
+// node_pool_test:
+//   Nodes of handled messages go back to the node pool of looper, and are
+//   handed out again with a cleared buffer
+static void node_pool_test(struct mlooper_attr *mattr)
+{
+    static const int expected[] = { 0, 1, 2, 3, 4 };
+    struct mlooper_attr pool_attr = *mattr;
+    struct message *msgs[NODE_POOL_MSG_COUNT], *msg;
+    char zero[NODE_POOL_BUF_SIZE];
+    int i, k, reused = 0, dirty = 0;
+    mlooper_handle looper;
+
+    pool_attr.pool_capacity = 2 * NODE_POOL_MSG_COUNT;
+    looper = order_looper_create(&pool_attr);
+    if (looper == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper");
+        return;
+    }
+    mlooper_start(looper);
+
+    for (i = 0; i < NODE_POOL_MSG_COUNT; i++) {
+        msgs[i] = mlooper_message_obtain_buffer_obtain(looper, 0, i, 0, NODE_POOL_BUF_SIZE);
+        if (msgs[i] == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to obtain message from node pool");
+            mlooper_destroy(looper);
+            return;
+        }
+        memset(msgs[i]->data, 0xff, NODE_POOL_BUF_SIZE);
+    }
+    for (i = 0; i < NODE_POOL_MSG_COUNT; i++)
+        mlooper_post_message(looper, msgs[i]);
+    // looper thread frees each message before handling next one, so all
+    // pooled nodes are back once the sync message returns
+    mlooper_send_message_sync(looper, message_obtain(0, NODE_POOL_MSG_COUNT, 0, NULL), NULL);
+    check_order("node_pool_test", expected, sizeof(expected)/sizeof(expected[0]));
+
+    memset(zero, 0x0, sizeof(zero));
+    for (i = 0; i < NODE_POOL_MSG_COUNT; i++) {
+        msg = mlooper_message_obtain_buffer_obtain(looper, 0, i, 0, NODE_POOL_BUF_SIZE);
+        if (msg == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to obtain message from node pool");
+            break;
+        }
+        for (k = 0; k < NODE_POOL_MSG_COUNT; k++) {
+            if (msg == msgs[k])
+                reused++;
+        }
+        if (memcmp(msg->data, zero, sizeof(zero)) != 0)
+            dirty++;
+        mlooper_post_message(looper, msg);
+    }
+
+    if (reused == NODE_POOL_MSG_COUNT && dirty == 0)
+        OS_LOGI(LOG_TAG, "node_pool_test: succeed to reuse %d pooled nodes", reused);
+    else
+        OS_LOGE(LOG_TAG, "node_pool_test: reused [%d] nodes, [%d] with stale buffer", reused, dirty);
+    mlooper_destroy(looper);
+}
+
+// coalesce_test:
+//   DROP_NEW keeps the pending message, REPLACE takes its place and schedule
+//   unless the new message would time out before that schedule
+static void coalesce_test(struct mlooper_attr *mattr)
+{
+    static const int expected[] = { 4, 6, 3 };
+    mlooper_handle looper = order_looper_create(mattr);
+    struct message *msg;
+    int ret;
+
+    if (looper == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper");
+        return;
+    }
+
+    mlooper_post_message_delay(looper, message_obtain(1, 1, 0, NULL), 100);
+    ret = mlooper_post_message_coalesce(looper, message_obtain(1, 2, 0, NULL), 0,
+                                        MLOOPER_COALESCE_DROP_NEW);
+    if (ret != 1)
+        OS_LOGE(LOG_TAG, "coalesce_test: DROP_NEW returns [%d] instead of 1", ret);
+    // inherits the 100ms schedule, so it's handled last
+    ret = mlooper_post_message_coalesce(looper, message_obtain(1, 3, 0, NULL), 0,
+                                        MLOOPER_COALESCE_REPLACE);
+    if (ret != 0)
+        OS_LOGE(LOG_TAG, "coalesce_test: REPLACE returns [%d] instead of 0", ret);
+    ret = mlooper_post_message_coalesce(looper, message_obtain(2, 4, 0, NULL), 0,
+                                        MLOOPER_COALESCE_REPLACE);
+    if (ret != 0)
+        OS_LOGE(LOG_TAG, "coalesce_test: posting without pending returns [%d]", ret);
+
+    // would time out at the pending schedule, so it keeps its own
+    mlooper_post_message_delay(looper, message_obtain(3, 5, 0, NULL), 300);
+    msg = message_obtain(3, 6, 0, NULL);
+    message_set_timeout_cb(msg, msg_timeout, 50);
+    mlooper_post_message_coalesce(looper, msg, 0, MLOOPER_COALESCE_REPLACE);
+
+    if (mlooper_message_count(looper) != 3)
+        OS_LOGE(LOG_TAG, "coalesce_test: [%u] messages pending instead of 3",
+                mlooper_message_count(looper));
+    mlooper_start(looper);
+
+    check_order("coalesce_test", expected, sizeof(expected)/sizeof(expected[0]));
+    mlooper_destroy(looper);
+}
+
+static mlooper_handle sync_looper = NULL;
+static int sync_inline_ret = -2;
+static int sync_inline_result = 0;
+
+// sync_handle:
+//   Result is twice of arg1, message what=1 also sends a message to looper
+//   itself from handler, which is handled inline
+static void sync_handle(struct message *msg)
+{
+    if (msg->what == 1)
+        sync_inline_ret = mlooper_send_message_sync(sync_looper, message_obtain(0, 21, 0, NULL),
+                                                    &sync_inline_result);
+    message_set_result(msg, msg->arg1 * 2);
+}
+
+// sync_send_test:
+//   mlooper_send_message_sync() returns the handler result, fails fast if
+//   looper isn't running, and doesn't deadlock when called on looper thread
+static void sync_send_test(struct mlooper_attr *mattr)
+{
+    int ret, result = 0;
+
+    sync_looper = mlooper_create_with_attr(mattr, sync_handle, order_free);
+    if (sync_looper == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper");
+        return;
+    }
+
+    ret = mlooper_send_message_sync(sync_looper, message_obtain(0, 1, 0, NULL), &result);
+    if (ret != -1)
+        OS_LOGE(LOG_TAG, "sync_send_test: send before start returns [%d]", ret);
+
+    mlooper_start(sync_looper);
+    ret = mlooper_send_message_sync(sync_looper, message_obtain(0, 5, 0, NULL), &result);
+    if (ret != 0 || result != 10)
+        OS_LOGE(LOG_TAG, "sync_send_test: send returns [%d], result [%d]", ret, result);
+    ret = mlooper_send_message_sync(sync_looper, message_obtain(1, 7, 0, NULL), &result);
+    if (ret != 0 || result != 14 || sync_inline_ret != 0 || sync_inline_result != 42)
+        OS_LOGE(LOG_TAG, "sync_send_test: nested send returns [%d], result [%d]",
+                sync_inline_ret, sync_inline_result);
+
+    mlooper_stop(sync_looper);
+    ret = mlooper_send_message_sync(sync_looper, message_obtain(0, 1, 0, NULL), &result);
+    if (ret != -1)
+        OS_LOGE(LOG_TAG, "sync_send_test: send after stop returns [%d]", ret);
+    else
+        OS_LOGI(LOG_TAG, "sync_send_test: succeed to send messages synchronously");
+    mlooper_destroy(sync_looper);
+}
+
+// sync_slow_handle:
+//   Keep looper busy on what=1, so messages posted meanwhile stay in inbox
+static void sync_slow_handle(struct message *msg)
+{
+    if (msg->what == 1)
+        os_thread_sleep_msec(50);
+    order_handle(msg);
+}
+
+// sync_after_lockfree_test:
+//   Messages posted lock-free by a thread are handled before a message it
+//   sends synchronously afterwards
+static void sync_after_lockfree_test(struct mlooper_attr *mattr)
+{
+    static const int expected[] = { 0, 1, 2, 3, 4, 5 };
+    struct mlooper_attr lockfree_attr = *mattr;
+    mlooper_handle looper;
+    int i;
+
+    lockfree_attr.flags |= MLOOPER_FLAG_LOCKFREE_POST;
+    order_count = 0;
+    looper = mlooper_create_with_attr(&lockfree_attr, sync_slow_handle, order_free);
+    if (looper == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper");
+        return;
+    }
+    mlooper_start(looper);
+
+    mlooper_post_message(looper, message_obtain(1, 0, 0, NULL));
+    os_thread_sleep_msec(10);
+    for (i = 1; i < 5; i++)
+        mlooper_post_message(looper, message_obtain(0, i, 0, NULL));
+    mlooper_send_message_sync(looper, message_obtain(0, 5, 0, NULL), NULL);
+    check_order("sync_after_lockfree_test", expected, sizeof(expected)/sizeof(expected[0]));
+    mlooper_destroy(looper);
+}
+
+static volatile int idle_count = 0;
+static volatile int idle_once_count = 0;
+
+static bool idle_handle(void *arg)
+{
+    idle_count++;
+    return true;
+}
+
+static bool idle_once_handle(void *arg)
+{
+    idle_once_count++;
+    return false;
+}
+
+// idle_handler_test:
+//   Idle handlers run once each time looper becomes idle, one that returns
+//   false is dropped, and a removed one doesn't run any more
+static void idle_handler_test(struct mlooper_attr *mattr)
+{
+    mlooper_handle looper = order_looper_create(mattr);
+    if (looper == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to create looper");
+        return;
+    }
+
+    mlooper_add_idle_handler(looper, idle_handle, NULL);
+    mlooper_add_idle_handler(looper, idle_once_handle, NULL);
+    mlooper_start(looper);
+    os_thread_sleep_msec(50);
+    if (idle_count != 1 || idle_once_count != 1)
+        OS_LOGE(LOG_TAG, "idle_handler_test: idle handlers run [%d]/[%d] times after start",
+                idle_count, idle_once_count);
+
+    // idle again after a message is handled, one-shot handler is gone
+    mlooper_post_message(looper, message_obtain(0, 0, 0, NULL));
+    os_thread_sleep_msec(50);
+    if (idle_count != 2 || idle_once_count != 1)
+        OS_LOGE(LOG_TAG, "idle_handler_test: idle handlers run [%d]/[%d] times after message",
+                idle_count, idle_once_count);
+
+    mlooper_remove_idle_handler(looper, idle_handle, NULL);
+    mlooper_post_message(looper, message_obtain(0, 1, 0, NULL));
+    os_thread_sleep_msec(50);
+    if (idle_count != 2 || idle_once_count != 1)
+        OS_LOGE(LOG_TAG, "idle_handler_test: removed idle handler runs [%d] times", idle_count);
+    else
+        OS_LOGI(LOG_TAG, "idle_handler_test: succeed to run idle handlers");
+    mlooper_destroy(looper);
+}
+
 int main()
 {
     struct os_thread_attr attr;
@@ -92,5 +467,38 @@ int main()
 
     os_thread_sleep_msec(5000);
     mlooper_destroy(looper);
+
+    {
+        mlooper_pool_handle pool = mlooper_pool_create(&attr, 4, msg_handle, msg_free);
+        mlooper_pool_start(pool);
+
+        for (int i = 0; i < 8; i++) {
+            str = OS_STRDUP("mlooper_pool_post_message");
+            msg = message_obtain(i+200, 0, 0, (void *)str);
+            mlooper_pool_post_message(pool, msg);
+        }
+        for (int i = 0; i < 4; i++) {
+            str = OS_STRDUP("mlooper_pool_post_affinity_message");
+            msg = message_obtain(i+300, 0, 0, (void *)str);
+            mlooper_pool_post_affinity_message(pool, msg, 1);
+        }
+
+        os_thread_sleep_msec(1000);
+        mlooper_pool_destroy(pool);
+    }
+
+    {
+        struct mlooper_attr mattr;
+        memset(&mattr, 0x0, sizeof(mattr));
+        mattr.thread_attr = attr;
+
+        order_test(&mattr);
+        lockfree_post_test(&mattr);
+        node_pool_test(&mattr);
+        coalesce_test(&mattr);
+        sync_send_test(&mattr);
+        sync_after_lockfree_test(&mattr);
+        idle_handler_test(&mattr);
+    }
     return 0;
 }
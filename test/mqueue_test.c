@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "osal/os_thread.h"
+#include "osal/os_time.h"
 #include "cutils/memory_helper.h"
 #include "cutils/log_helper.h"
 #include "cutils/mqueue.h"
@@ -17,10 +18,169 @@
 
 #define QUEUE_SET_LENGTH    (QUEUE_1_LENGTH + QUEUE_2_LENGTH)
 
+#define THROUGHPUT_SENDERS      8
+#define THROUGHPUT_MSG_COUNT    100000
+#define THROUGHPUT_BATCH        50
+
 static mqset_handle set = NULL;
 static mq_handle queue1 = NULL;
 static mq_handle queue2 = NULL;
 
+static mq_handle throughput_queue = NULL;
+
+static void *throughput_send_thread(void *arg)
+{
+    unsigned int msgs[THROUGHPUT_BATCH];
+    unsigned int i, k, sent;
+    int ret;
+
+    for (i = 0; i < THROUGHPUT_MSG_COUNT; i += THROUGHPUT_BATCH) {
+        for (k = 0; k < THROUGHPUT_BATCH; k++)
+            msgs[k] = i + k;
+        for (sent = 0; sent < THROUGHPUT_BATCH; sent += ret) {
+            ret = mqueue_send_batch(throughput_queue, (char *)&msgs[sent], THROUGHPUT_BATCH - sent, 1000);
+            if (ret < 0)
+                return NULL;
+        }
+    }
+    return NULL;
+}
+
+// queue_throughput_test:
+//   Throughput of many senders and one receiver on a locked or lock-free
+//   queue, it compares the two queue kinds, not padding on and off
+static void queue_throughput_test(bool lockfree)
+{
+    os_thread tids[THROUGHPUT_SENDERS];
+    unsigned long long sum = 0, start;
+    unsigned int msg, received = 0;
+    char *slot;
+    int i;
+
+    if (lockfree)
+        throughput_queue = mqueue_create_lockfree(sizeof(unsigned int), 256);
+    else
+        throughput_queue = mqueue_create(sizeof(unsigned int), 256);
+    if (throughput_queue == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate queue");
+        return;
+    }
+
+    start = os_monotonic_usec();
+    for (i = 0; i < THROUGHPUT_SENDERS; i++)
+        tids[i] = os_thread_create(NULL, throughput_send_thread, NULL);
+
+    while (received < THROUGHPUT_SENDERS * THROUGHPUT_MSG_COUNT &&
+           (slot = mqueue_receive_peek(throughput_queue, 2000)) != NULL) {
+        memcpy(&msg, slot, sizeof(msg));
+        mqueue_receive_release(throughput_queue, slot);
+        sum += msg;
+        received++;
+    }
+
+    for (i = 0; i < THROUGHPUT_SENDERS; i++)
+        os_thread_join(tids[i], NULL);
+
+    if (sum == (unsigned long long)THROUGHPUT_SENDERS * THROUGHPUT_MSG_COUNT * (THROUGHPUT_MSG_COUNT - 1) / 2)
+        OS_LOGI(LOG_TAG, "Succeed to receive %u msgs from %s queue in %llums", received,
+                lockfree ? "lock-free" : "locked", (os_monotonic_usec() - start) / 1000);
+    else
+        OS_LOGE(LOG_TAG, "Queue lost msgs, received %u", received);
+
+    mqueue_destroy(throughput_queue);
+}
+
+static void zero_copy_queue_test(bool lockfree)
+{
+    mq_handle queue;
+    unsigned int i, msg;
+    char *slot;
+
+    if (lockfree)
+        queue = mqueue_create_lockfree(sizeof(unsigned int), 4);
+    else
+        queue = mqueue_create(sizeof(unsigned int), 4);
+    if (queue == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate queue");
+        return;
+    }
+
+    for (i = 0; i < 10; i++) {
+        slot = mqueue_send_reserve(queue, 0);
+        if (slot == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to reserve slot");
+            break;
+        }
+        memcpy(slot, &i, sizeof(i));
+        if (mqueue_send_commit(queue, slot) != 0 || mqueue_send_commit(queue, slot) == 0) {
+            OS_LOGE(LOG_TAG, "Commit of reserved slot returns wrong result");
+            break;
+        }
+
+        slot = mqueue_receive_peek(queue, 0);
+        if (slot == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to peek slot");
+            break;
+        }
+        memcpy(&msg, slot, sizeof(msg));
+        if (mqueue_receive_release(queue, slot) != 0 || mqueue_receive_release(queue, slot) == 0) {
+            OS_LOGE(LOG_TAG, "Release of peeked slot returns wrong result");
+            break;
+        }
+        if (msg != i) {
+            OS_LOGE(LOG_TAG, "Peeked msg=[%u], expected=[%u]", msg, i);
+            break;
+        }
+    }
+    if (i == 10)
+        OS_LOGI(LOG_TAG, "Succeed to reserve/commit and peek/release on %s queue",
+                lockfree ? "lock-free" : "locked");
+
+    mqueue_destroy(queue);
+}
+
+static void prio_queue_test()
+{
+    mq_handle queue = mqueue_create_prio(sizeof(unsigned int), 8, 4);
+    unsigned int prio, msg;
+
+    if (queue == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate priority queue");
+        return;
+    }
+
+    for (prio = 0; prio < 4; prio++)
+        mqueue_send_prio(queue, (char *)&prio, (prio * 3) % 4, 0);
+    while (mqueue_receive(queue, (char *)&msg, 0) == 0)
+        OS_LOGI(LOG_TAG, "Succeed to receive msg=[%u] with priority=[%u]", msg, (msg * 3) % 4);
+
+    mqueue_destroy(queue);
+}
+
+static void varlen_queue_test()
+{
+    mq_handle queue = mqueue_create_varlen(64);
+    char str[STR_LENGTH];
+    int i, len;
+
+    if (queue == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate variable-length queue");
+        return;
+    }
+
+    // records of different sizes wrap around the end of ring
+    for (i = 0; i < 8; i++) {
+        len = snprintf(str, sizeof(str), "varlen-%0*d", (i % 4) * 3 + 1, i);
+        mqueue_send_varlen(queue, str, len + 1, 0);
+        if (i % 2 == 0)
+            continue;
+        while ((len = mqueue_receive_varlen(queue, str, sizeof(str), 0)) > 0)
+            OS_LOGI(LOG_TAG, "Succeed to receive msg=[%s] with len=[%d]", str, len);
+    }
+
+    mqueue_destroy(queue);
+}
+
 static void *queue_send_thread(void *arg)
 {
     char str[STR_LENGTH];
@@ -79,6 +239,13 @@ int main()
         }
     }
 
+    queue_throughput_test(false);
+    queue_throughput_test(true);
+    zero_copy_queue_test(false);
+    zero_copy_queue_test(true);
+    prio_queue_test();
+    varlen_queue_test();
+
 error:
     if (set != NULL)
         mqueueset_destroy(set);